@@ -1,6 +1,8 @@
 
 
 #include <iostream>
+#include <memory>
+#include <new>
 #include <sstream>
 #include <queue>
 #include <vector>
@@ -9,242 +11,4687 @@
 #include <iomanip>
 #include <fstream>
 #include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
-const int TAXI_CAPACITY = 5;
+// Built with -DTAXI_BENCHMARK, every heap allocation in the program goes
+// through here, so the benchmark can report allocations per passenger. Each
+// thread counts its own, so threads never share the counter's cache line; the
+// benchmark phases run on the calling thread and read that thread's count.
+// Other builds keep the standard allocator and report no allocation counts.
+#ifdef TAXI_BENCHMARK
+const bool countsAllocations = true;
+thread_local uint64_t heapAllocations = 0;
+
+void* countedAllocation(size_t size) noexcept {
+    heapAllocations++;
+    return malloc(size == 0 ? 1 : size);
+}
+// Kept out of line so GCC does not see free() applied to operator new's result.
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void countedRelease(void* block) noexcept { free(block); }
+void* operator new(size_t size) {
+    if (void* block = countedAllocation(size)) return block;
+    throw bad_alloc();
+}
+void* operator new[](size_t size) {
+    if (void* block = countedAllocation(size)) return block;
+    throw bad_alloc();
+}
+void* operator new(size_t size, const nothrow_t&) noexcept { return countedAllocation(size); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return countedAllocation(size); }
+void operator delete(void* block) noexcept { countedRelease(block); }
+void operator delete[](void* block) noexcept { countedRelease(block); }
+void operator delete(void* block, size_t) noexcept { countedRelease(block); }
+void operator delete[](void* block, size_t) noexcept { countedRelease(block); }
+void operator delete(void* block, const nothrow_t&) noexcept { countedRelease(block); }
+void operator delete[](void* block, const nothrow_t&) noexcept { countedRelease(block); }
+#else
+const bool countsAllocations = false;
+const uint64_t heapAllocations = 0;
+#endif
+
+const int TAXI_CAPACITY = 5; // Seats per taxi when the route table does not say otherwise.
 struct Passenger{
     char routeType;
+    unsigned char priority = 0; // Boards ahead of the queue under the priority policy.
     int boardingTime;
     int arrivalTime;
     };
 
-    queue<Passenger> shortQueue;
-    queue<Passenger> longQueue;
-    queue<Passenger> cityQueue;
+// Routes served by the rank. Each route has a one-character routeType code (the
+// same code used in the trace), a number of taxis loading side by side and a
+// seat count. Taxis are numbered consecutively route by route, so the taxis of
+// route r are firstTaxi[r] .. firstTaxi[r] + taxiCount[r] - 1.
+struct RouteTable {
+    vector<char> labels;
+    vector<int> taxiCount;
+    vector<int> capacity;
+    vector<int> firstTaxi;
+    vector<int> taxiRoute;  // Route of every taxi.
+    int indexByLabel[256];  // Route index for each routeType byte, -1 if unknown.
+
+    RouteTable() { fill(begin(indexByLabel), end(indexByLabel), -1); }
+
+    int routeCount() const { return static_cast<int>(labels.size()); }
+    int totalTaxis() const { return static_cast<int>(taxiRoute.size()); }
 
-struct TaxiRouteState{
-    queue<Passenger> passengerQueue;
-    vector<Passenger> onBoardList;
-    bool isBoarding = false;
-    int boardingTimer = 0;
-    Passenger currentBoardingPassenger;
-    int currentCapacity = TAXI_CAPACITY;
-    string status = "Waiting";
+    // O(1) dispatch of a passenger to its route.
+    int routeIndex(char routeType) const { return indexByLabel[static_cast<unsigned char>(routeType)]; }
 
+    void addRoute(char label, int taxis, int seats) {
+        if (routeIndex(label) != -1) {
+            throw runtime_error(string("Route ") + label + " is listed more than once.");
+        }
+        if (taxis < 1 || seats < 1) {
+            throw runtime_error(string("Route ") + label + " needs at least one taxi and one seat.");
+        }
+        int route = routeCount();
+        indexByLabel[static_cast<unsigned char>(label)] = route;
+        labels.push_back(label);
+        taxiCount.push_back(taxis);
+        capacity.push_back(seats);
+        firstTaxi.push_back(totalTaxis());
+        taxiRoute.insert(taxiRoute.end(), taxis, route);
+    }
 };
 
 // Short-distance route ('S'), Long-distance route ('L'), City route ('C').
-TaxiRouteState shortTaxi, longTaxi, cityTaxi;
+RouteTable defaultRouteTable() {
+    RouteTable table;
+    table.addRoute('S', 1, TAXI_CAPACITY);
+    table.addRoute('L', 1, TAXI_CAPACITY);
+    table.addRoute('C', 1, TAXI_CAPACITY);
+    return table;
+}
+
+// Reads a route table with one "routeType,taxis[,capacity]" line per route.
+// Blank lines and lines starting with '#' are ignored.
+RouteTable loadRouteTable(const string& filename) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        throw runtime_error("Unable to open route table. " + filename);
+    }
+
+    RouteTable table;
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+        line.erase(remove(line.begin(), line.end(), '\r'), line.end());
+        size_t first = line.find_first_not_of(" \t");
+        if (first == string::npos || line[first] == '#') continue;
+
+        stringstream ss(line);
+        string label, taxis, seats;
+        getline(ss, label, ',');
+        getline(ss, taxis, ',');
+        getline(ss, seats, ',');
+        label.erase(remove_if(label.begin(), label.end(), [](unsigned char c) { return isspace(c); }), label.end());
+
+        try {
+            if (label.size() != 1) throw invalid_argument("label");
+            table.addRoute(label[0], stoi(taxis), seats.empty() ? TAXI_CAPACITY : stoi(seats));
+        } catch (const logic_error&) {
+            throw runtime_error("Bad route table entry on line " + to_string(lineNumber) + " of " + filename + ": " + line);
+        }
+    }
+    if (table.routeCount() == 0) {
+        throw runtime_error("Route table " + filename + " does not list any routes.");
+    }
+    return table;
+}
+
+enum class TaxiStatus : unsigned char { Waiting, Board, Departed };
+
+const char* statusName(TaxiStatus status) {
+    switch (status) {
+    case TaxiStatus::Board: return "Board";
+    case TaxiStatus::Departed: return "Departed";
+    default: return "Waiting";
+    }
+}
+
+// FIFO queue of passengers stored in one contiguous ring buffer. Unlike
+// std::queue it can be read in place from front to back, so the table can show
+// what is waiting without copying the queue. The capacity is a power of two and
+// doubles when full, so push and pop are O(1) and allocation is rare.
+class PassengerQueue {
+public:
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    const Passenger& front() const { return slots[head]; }
+
+    // The i-th waiting passenger, 0 being the front.
+    const Passenger& operator[](size_t i) const { return slots[(head + i) & (slots.size() - 1)]; }
+
+    void push(const Passenger& p) {
+        if (count == slots.size()) grow();
+        slots[(head + count) & (slots.size() - 1)] = p;
+        count++;
+    }
+
+    void pop() {
+        assert(count > 0 && "pop from an empty PassengerQueue");
+        head = (head + 1) & (slots.size() - 1);
+        count--;
+    }
+
+    // Removes the i-th waiting passenger; the ones ahead of it move up a place.
+    Passenger takeAt(size_t i) {
+        assert(i < count && "takeAt past the end of a PassengerQueue");
+        Passenger taken = (*this)[i];
+        for (size_t k = i; k > 0; k--) slots[(head + k) & (slots.size() - 1)] = (*this)[k - 1];
+        pop();
+        return taken;
+    }
+
+    class const_iterator {
+    public:
+        const_iterator(const PassengerQueue* q, size_t i) : queue(q), index(i) {}
+        const Passenger& operator*() const { return (*queue)[index]; }
+        const Passenger* operator->() const { return &(*queue)[index]; }
+        const_iterator& operator++() { index++; return *this; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+    private:
+        const PassengerQueue* queue;
+        size_t index;
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+
+private:
+    void grow() {
+        vector<Passenger> larger(slots.empty() ? 16 : slots.size() * 2);
+        for (size_t i = 0; i < count; i++) larger[i] = (*this)[i];
+        slots.swap(larger);
+        head = 0;
+    }
+
+    vector<Passenger> slots;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+// Kinds of events the discrete-event engine reacts to.
+enum EventType {
+    EVENT_ARRIVAL,            // A passenger joins a route queue.
+    EVENT_BOARDING_COMPLETE,  // The passenger being boarded has taken a seat.
+    EVENT_DEPARTURE,          // A full taxi pulls out and an empty one takes its place.
+    EVENT_TIMEOUT             // A policy deadline, e.g. a taxi may now leave part-full.
+};
+
+struct SimulationEvent {
+    int time;
+    EventType type;
+    int taxiIndex;
+};
+
+// Orders the event queue so the earliest event (then lowest taxi number) is on top.
+struct LaterEvent {
+    bool operator()(const SimulationEvent& a, const SimulationEvent& b) const {
+        if (a.time != b.time) return a.time > b.time;
+        return a.taxiIndex > b.taxiIndex;
+    }
+};
+
+// Histogram of non-negative integers in logarithmic buckets. Values below 32
+// have a bucket each; larger values share 16 buckets per power of two, so any
+// percentile is within 6.25% of the true value. Memory is fixed whatever is
+// recorded and record() is O(1), so histograms can stay on in long runs.
+class LogHistogram {
+public:
+    static const int BUCKETS = 960; // Enough for every non-negative long long, e.g. nanosecond latencies.
+
+    void record(long long value) {
+        if (value < 0) value = 0;
+        counts[bucketOf(static_cast<uint64_t>(value))]++;
+        if (total == 0 || value < minimum) minimum = value;
+        if (value > maximum) maximum = value;
+        total++;
+        sum += value;
+    }
+
+    void merge(const LogHistogram& other) {
+        if (other.total == 0) return;
+        for (int i = 0; i < BUCKETS; i++) counts[i] += other.counts[i];
+        minimum = total == 0 ? other.minimum : min(minimum, other.minimum);
+        maximum = max(maximum, other.maximum);
+        total += other.total;
+        sum += other.sum;
+    }
+
+    // Checkpoint support: only the non-empty buckets are written.
+    template <typename Out>
+    void save(Out& out) const {
+        int used = 0;
+        for (int i = 0; i < BUCKETS; i++) used += counts[i] != 0;
+        out.put(used, 2);
+        for (int i = 0; i < BUCKETS; i++) {
+            if (counts[i] == 0) continue;
+            out.put(i, 2);
+            out.put(counts[i], 8);
+        }
+        out.put(total, 8);
+        out.put(sum, 8);
+        out.put(minimum, 8);
+        out.put(maximum, 8);
+    }
+
+    template <typename In>
+    void load(In& in) {
+        fill(begin(counts), end(counts), 0LL);
+        for (int used = static_cast<int>(in.get(2)); used > 0; used--) {
+            uint64_t bucket = in.get(2);
+            if (bucket >= BUCKETS) throw runtime_error("Corrupt histogram in checkpoint.");
+            counts[bucket] = in.get(8);
+        }
+        total = in.get(8);
+        sum = in.get(8);
+        minimum = in.get(8);
+        maximum = in.get(8);
+    }
+
+    long long count() const { return total; }
+    long long largest() const { return maximum; }
+    double mean() const { return total > 0 ? static_cast<double>(sum) / total : 0.0; }
+
+    // Nearest-rank percentile, e.g. percentile(0.95). Returns the lower edge of
+    // the bucket holding that rank, clamped to the recorded range.
+    long long percentile(double fraction) const {
+        if (total == 0) return 0;
+        long long target = max(1LL, static_cast<long long>(ceil(fraction * total)));
+        long long seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= target) return min(max(lowerBound(i), minimum), maximum);
+        }
+        return maximum;
+    }
+
+private:
+    static int highestBit(uint64_t value) {
+        int bit = 0;
+        while (value >>= 1) bit++;
+        return bit;
+    }
+
+    static int bucketOf(uint64_t value) {
+        if (value < 32) return static_cast<int>(value);
+        int msb = highestBit(value);
+        return (msb - 3) * 16 + static_cast<int>((value >> (msb - 4)) - 16);
+    }
+
+    static long long lowerBound(int bucket) {
+        if (bucket < 32) return bucket;
+        int msb = bucket / 16 + 3;
+        return static_cast<long long>(bucket % 16 + 16) << (msb - 4);
+    }
+
+    long long counts[BUCKETS] = {};
+    long long total = 0;
+    long long sum = 0;
+    long long minimum = 0;
+    long long maximum = 0;
+};
+
+// Instrumentation kept for each route while the simulation runs.
+struct RouteMetrics {
+    LogHistogram wait;        // Boarding start minus arrivalTime, per passenger.
+    LogHistogram fillTime;    // From an empty taxi pulling in to it leaving full.
+    LogHistogram queueDepth;  // Queue length seen by each arriving passenger.
+    long long busyTime = 0;   // Taxi time units spent boarding passengers.
+    long long departures = 0;
+};
+
+// Live state of one simulation run. Per-taxi fields are kept as parallel arrays
+// indexed by taxi number (struct of arrays), so the hot loop only touches the
+// fields it needs. Nothing here is shared, so several runs can go at once.
+struct RankState {
+    // Per route.
+    vector<PassengerQueue> passengerQueues;
+
+    // Per taxi.
+    vector<TaxiStatus> status;
+    vector<unsigned char> isBoarding;
+    vector<int> boardingTimer;        // Time at which the current boarding (or departure) completes.
+    vector<int> currentCapacity;      // Seats still free.
+    vector<Passenger> currentBoardingPassenger;  // The last of the group being boarded.
+    vector<int> boardingCount;        // Passengers in the group being boarded (batch policies).
+    vector<int> onBoardOffset;        // First seat of each taxi in onBoardSeats.
+    vector<Passenger> onBoardSeats;   // Passengers seated, capacity[route] slots per taxi.
+    vector<int> pulledInAt;           // When the current (empty) taxi arrived at the rank.
+    vector<int> firstSeatedAt;        // When the current taxi's first passenger took a seat (timeout policy).
+
+    // Pending boarding completions and departures. Arrivals are not stored here;
+    // they are read straight from the arrival source by runSimulation.
+    priority_queue<SimulationEvent, vector<SimulationEvent>, LaterEvent> eventQueue;
+
+    // Totals that let the end-of-simulation check run in O(1).
+    size_t waitingPassengers = 0;
+    int activeBoardings = 0;
+
+    // Running totals for the end-of-run summary.
+    long long passengersBoarded = 0;
+    long long totalWait = 0;           // Sum of (boarding start - arrivalTime).
+    long long departures = 0;
+    long long eventsProcessed = 0;     // Arrivals plus boarding and departure events.
+    vector<RouteMetrics> routeMetrics;
+
+    explicit RankState(const RouteTable& table) {
+        int taxis = table.totalTaxis();
+        passengerQueues.resize(table.routeCount());
+        routeMetrics.resize(table.routeCount());
+        pulledInAt.assign(taxis, 0);
+        firstSeatedAt.assign(taxis, 0);
+        status.assign(taxis, TaxiStatus::Waiting);
+        isBoarding.assign(taxis, 0);
+        boardingTimer.assign(taxis, 0);
+        currentCapacity.resize(taxis);
+        currentBoardingPassenger.assign(taxis, Passenger{'?', 0, 0, 0});
+        boardingCount.assign(taxis, 1);
+        onBoardOffset.resize(taxis);
+
+        int seats = 0;
+        for (int taxi = 0; taxi < taxis; taxi++) {
+            int route = table.taxiRoute[taxi];
+            currentCapacity[taxi] = table.capacity[route];
+            onBoardOffset[taxi] = seats;
+            seats += table.capacity[route];
+        }
+        onBoardSeats.resize(seats);
+    }
+};
+
+// What a finished run reports back to its caller.
+struct SimulationSummary {
+    int startTime = 0;
+    int endTime = 0;
+    long long eventsProcessed = 0;
+    long long passengersArrived = 0;
+    long long passengersBoarded = 0;
+    long long unknownRoutePassengers = 0;
+    long long departures = 0;
+    long long totalWait = 0;
+    size_t peakQueueLength = 0;        // Most passengers waiting at once, all routes together.
+    double queueLengthArea = 0.0;      // Integral of passengers waiting over time.
+    LogHistogram waitHistogram;        // All routes together.
+    vector<RouteMetrics> routeMetrics;
+
+    // Percentile of the passenger waits, e.g. percentileWait(0.95).
+    int percentileWait(double fraction) const { return static_cast<int>(waitHistogram.percentile(fraction)); }
+
+    double meanWait() const { return passengersBoarded > 0 ? static_cast<double>(totalWait) / passengersBoarded : 0.0; }
+    double duration() const { return endTime > startTime ? endTime - startTime : 1.0; }
+    double meanQueueLength() const { return queueLengthArea / duration(); }
+    double throughput() const { return passengersBoarded / duration(); }
+};
+
+// Everything a run needs to carry on from a given time: the rank, the totals so
+// far and the clock. A fresh state starts a run at the first arrival; a state
+// read back from a checkpoint resumes straight after the checkpointed time.
+struct SimulationState {
+    explicit SimulationState(const RouteTable& table) : rank(table) {}
 
-bool allProcessingComplete(int arrivalTracker, const vector<Passenger>& allPassengers) {
+    RankState rank;
+    SimulationSummary summary;     // Running totals; routeMetrics is filled in at the end.
+    bool started = false;
+    int previousTime = 0;          // Last time instance processed.
+
+    // Keep processing queued departures after every passenger has boarded,
+    // until the event queue is empty. Used by route shards, whose part of
+    // the run only ends when every other shard's does.
+    bool drainEvents = false;
+    bool restored = false;         // Read from a checkpoint; the trace up to previousTime is already in.
+
+    // Starts the clock: empty taxis are taken to have pulled in at this time.
+    void startAt(int timeInstance) {
+        summary.startTime = previousTime = timeInstance;
+        fill(rank.pulledInAt.begin(), rank.pulledInAt.end(), timeInstance);
+        started = true;
+    }
+};
+
+bool allProcessingComplete(bool allArrived, const RankState& rank) {
     // Check if all passengers have arrived and all queues are empty.
-    bool allArrived = (arrivalTracker >= allPassengers.size());
-    bool allQueuesEmpty = shortTaxi.passengerQueue.empty() && longTaxi.passengerQueue.empty() && cityTaxi.passengerQueue.empty();
-    bool noActiveBoarding = !shortTaxi.isBoarding && !longTaxi.isBoarding && !cityTaxi.isBoarding;
+    bool allQueuesEmpty = rank.waitingPassengers == 0;
+    bool noActiveBoarding = rank.activeBoardings == 0;
 
     return allArrived && allQueuesEmpty && noActiveBoarding;
 }
 
-// This is a helper function to print queue content as string.
-string getWaitingQueue(queue<Passenger> q){
-    stringstream ss;
-    if (q.empty()) return "0";
-    while(!q.empty()){
-        ss << q.front().routeType << "(" << q.front().boardingTime << ")";
-        q.pop(); // copy so original queue remains intact.
-    }
-    return ss.str();
-}
-
-void printTableHeader(){
-    cout << left
-    << setw(6)  << "Time"
-    << setw(15) << "Next"
-    << setw(6)  << "S"
-    << setw(6)  << "L"
-    << setw(6)  << "C"
-    << setw(14) << "WQS"
-    << setw(14) << "WQL"
-    << setw(14) << "WQC"
-    << setw(8)  << "CS"
-    << setw(10) << "StatS"
-    << setw(8)  << "CL"
-    << setw(10) << "StatL"
-    << setw(8)  << "CC"
-    << setw(10) << "StatC"
-    << endl;
+// How many waiting passengers the table shows per queue before summarising.
+const size_t DEFAULT_QUEUE_PREVIEW = 3;
+
+// Writes the decimal digits of value to text (at least 20 bytes) and returns
+// how many were written. Used instead of stream formatting on hot paths.
+size_t formatInt(long long value, char* text) {
+    char digits[20];
+    size_t count = 0;
+    unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value) : value;
+    do {
+        digits[count++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    size_t length = 0;
+    if (value < 0) text[length++] = '-';
+    while (count > 0) text[length++] = digits[--count];
+    return length;
 }
 
-// This will print the table row.
-void printSimulationRow(int timeInstance, const string& newArrivals,
-                       TaxiRouteState& shortTaxi, TaxiRouteState& longTaxi, TaxiRouteState& cityTaxi) {
-    cout << left
-    << setw(6) << timeInstance
-    << setw(15) << newArrivals
-    << setw(6) << shortTaxi.passengerQueue.size()
-    << setw(6) << longTaxi.passengerQueue.size()
-    << setw(6) << cityTaxi.passengerQueue.size()
-    << setw(14) << getWaitingQueue(shortTaxi.passengerQueue)
-    << setw(14) << getWaitingQueue(longTaxi.passengerQueue)
-    << setw(14) << getWaitingQueue(cityTaxi.passengerQueue)
-    << setw(8) << shortTaxi.currentCapacity  // Show current capacity.
-    << setw(10) << shortTaxi.status         // Show status.
-    << setw(8) << longTaxi.currentCapacity
-    << setw(10) << longTaxi.status
-    << setw(8) << cityTaxi.currentCapacity
-    << setw(10) << cityTaxi.status
-    << endl;
+// Appends "R(b)" for one passenger.
+void appendPassenger(string& out, const Passenger& p) {
+    char text[24];
+    out += p.routeType;
+    out += '(';
+    out.append(text, formatInt(p.boardingTime, text));
+    out += ')';
 }
 
-void processTaxiRoute(TaxiRouteState &taxiState, char routeLabel) {
-     if (taxiState.status == "Departed") {
-        taxiState.onBoardList.clear();
-        taxiState.currentCapacity = TAXI_CAPACITY;
-        taxiState.status = "Waiting";
-        
+// This is a helper function to print queue content as string.
+// It reads the queue in place and shows at most previewLimit passengers,
+// followed by "+n" for the rest, so the cost per row does not grow with the queue.
+void getWaitingQueue(const PassengerQueue& q, size_t previewLimit, string& out){
+    out.clear();
+    if (q.empty()) {
+        out = "0";
+        return;
     }
-    if (taxiState.isBoarding) {
-        taxiState.boardingTimer--;
+    size_t shown = min(previewLimit, q.size());
+    for (size_t i = 0; i < shown; i++) appendPassenger(out, q[i]);
+    if (shown < q.size()) {
+        char text[24];
+        out += '+';
+        out.append(text, formatInt(static_cast<long long>(q.size() - shown), text));
+    }
+}
 
-        if (taxiState.boardingTimer <= 0) {
-            taxiState.onBoardList.push_back(taxiState.currentBoardingPassenger);
-            taxiState.currentCapacity--;  // Decrease capacity.
-            taxiState.status = "Board";   // Set status to Board.
-            taxiState.isBoarding = false;
+// Preallocated output buffer. Writers append raw bytes and numbers to it and it
+// goes to the stream in large unformatted blocks, so no field goes through
+// iostream formatting and nothing is flushed per row.
+class OutputBuffer {
+public:
+    explicit OutputBuffer(ostream& stream, size_t capacity = 1 << 20) : out(stream), buffer(capacity) {}
+    ~OutputBuffer() { flush(); }
 
-            if (taxiState.currentCapacity <= 0) {  // Check if taxi is full.
-                taxiState.status = "Departed";
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
 
+    void append(const char* text, size_t length) {
+        if (buffer.size() - used < length) {
+            flush();
+            if (length > buffer.size()) {
+                out.write(text, length);
+                return;
             }
         }
+        memcpy(buffer.data() + used, text, length);
+        used += length;
+    }
+    void append(const string& text) { append(text.data(), text.size()); }
+    void append(const char* text) { append(text, strlen(text)); }
+    void put(char c) { append(&c, 1); }
+
+    void appendInt(long long value) {
+        char text[24];
+        append(text, formatInt(value, text));
+    }
+
+    // Left-aligned field padded with spaces to width, like setw(width) << left.
+    void appendPadded(const char* text, size_t length, size_t width) {
+        append(text, length);
+        for (size_t i = length; i < width; i++) put(' ');
+    }
+    void appendPadded(const string& text, size_t width) { appendPadded(text.data(), text.size(), width); }
+    void appendPadded(const char* text, size_t width) { appendPadded(text, strlen(text), width); }
+    void appendPaddedInt(long long value, size_t width) {
+        char text[24];
+        appendPadded(text, formatInt(value, text), width);
+    }
+
+    // Unsigned integer as width little-endian bytes, for binary output.
+    void appendLittleEndian(uint64_t value, int width) {
+        unsigned char bytes[8];
+        for (int i = 0; i < width; i++) bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+        append(reinterpret_cast<const char*>(bytes), width);
     }
 
-    if (!taxiState.isBoarding && !taxiState.passengerQueue.empty() && taxiState.currentCapacity > 0 && taxiState.currentCapacity > 0 && taxiState.status != "Departed") {
-        taxiState.currentBoardingPassenger = taxiState.passengerQueue.front();
-        taxiState.passengerQueue.pop();
-        taxiState.boardingTimer = taxiState.currentBoardingPassenger.boardingTime;
-        taxiState.isBoarding = true;
+    void flush() {
+        if (used > 0) out.write(buffer.data(), used);
+        used = 0;
+        out.flush();
     }
+
+private:
+    ostream& out;
+    vector<char> buffer;
+    size_t used = 0;
+};
+
+// Column name for a per-taxi field; the taxi number is only added when a route
+// has more than one taxi, so the three-route table keeps its familiar headings.
+string taxiColumnName(const string& prefix, const RouteTable& table, int taxi) {
+    int route = table.taxiRoute[taxi];
+    string name = prefix + table.labels[route];
+    if (table.taxiCount[route] > 1) name += to_string(taxi - table.firstTaxi[route] + 1);
+    return name;
 }
-const int MAX_TIME = 50; //Boarding time limit.
 
-void runSimulation(vector<Passenger>& allPassengers) {
-    size_t arrivalTracker = 0; // To track passengers already added.
-    bool simulationActive = true;
+void printTableHeader(OutputBuffer& out, const RouteTable& table){
+    out.appendPadded("Time", 6);
+    out.appendPadded("Next", 15);
+    for (int r = 0; r < table.routeCount(); r++) out.appendPadded(&table.labels[r], 1, 6);
+    for (int r = 0; r < table.routeCount(); r++) out.appendPadded(string("WQ") + table.labels[r], 14);
+    for (int taxi = 0; taxi < table.totalTaxis(); taxi++) {
+        out.appendPadded(taxiColumnName("C", table, taxi), 8);
+        out.appendPadded(taxiColumnName("Stat", table, taxi), 10);
+    }
+    out.put('\n');
+}
+
+// This will print the table row.
+void printSimulationRow(OutputBuffer& out, int timeInstance, const string& newArrivals,
+                       const RouteTable& table, const RankState& rank, size_t previewLimit, string& preview) {
+    out.appendPaddedInt(timeInstance, 6);
+    out.appendPadded(newArrivals, 15);
+    for (int r = 0; r < table.routeCount(); r++) out.appendPaddedInt(rank.passengerQueues[r].size(), 6);
+    for (int r = 0; r < table.routeCount(); r++) {
+        getWaitingQueue(rank.passengerQueues[r], previewLimit, preview);
+        out.appendPadded(preview, 14);
+    }
+    for (int taxi = 0; taxi < table.totalTaxis(); taxi++) {
+        out.appendPaddedInt(rank.currentCapacity[taxi], 8);        // Show current capacity.
+        out.appendPadded(statusName(rank.status[taxi]), 10);       // Show status.
+    }
+    out.put('\n');
+}
+
+// Writes the end-of-run figures shared by the table and summary modes.
+void printRunSummary(OutputBuffer& out, const SimulationSummary& summary) {
+    char text[160];
+    auto line = [&](const char* label, const char* value) {
+        out.appendPadded(label, 24);
+        out.append(": ");
+        out.append(value);
+        out.put('\n');
+    };
+    out.append("Simulation summary\n");
+    snprintf(text, sizeof(text), "%d .. %d", summary.startTime, summary.endTime);
+    line("Simulated time", text);
+    snprintf(text, sizeof(text), "%lld", summary.eventsProcessed);
+    line("Events processed", text);
+    snprintf(text, sizeof(text), "%lld (%lld with an unknown route)", summary.passengersArrived,
+             summary.unknownRoutePassengers);
+    line("Passengers arrived", text);
+    snprintf(text, sizeof(text), "%lld", summary.passengersBoarded);
+    line("Passengers boarded", text);
+    snprintf(text, sizeof(text), "%lld", summary.departures);
+    line("Taxi departures", text);
+    snprintf(text, sizeof(text), "%.3f", summary.meanWait());
+    line("Mean wait", text);
+    snprintf(text, sizeof(text), "%d / %d / %d", summary.percentileWait(0.50), summary.percentileWait(0.95),
+             summary.percentileWait(0.99));
+    line("Wait p50 / p95 / p99", text);
+    snprintf(text, sizeof(text), "%zu (mean %.3f)", summary.peakQueueLength, summary.meanQueueLength());
+    line("Peak queue length", text);
+    snprintf(text, sizeof(text), "%.4f passengers per time unit", summary.throughput());
+    line("Throughput", text);
+}
+
+// Per-route figures from the histograms: passengers boarded, throughput, wait
+// and fill-time percentiles, queue depth seen on arrival and taxi utilization
+// (share of taxi time spent boarding).
+void printRouteReport(OutputBuffer& out, const RouteTable& table, const SimulationSummary& summary) {
+    char text[256];
+    snprintf(text, sizeof(text), "\n%-6s%10s%10s  %-29s %-13s %-23s %6s\n", "Route", "Boarded", "Pax/unit",
+             "Wait p50/p95/p99/max", "Fill p50/p95", "QDepth p50/p95/max", "Util");
+    out.append(text);
+    for (int r = 0; r < table.routeCount() && r < static_cast<int>(summary.routeMetrics.size()); r++) {
+        const RouteMetrics& m = summary.routeMetrics[r];
+        char wait[64], fill[64], depth[64];
+        snprintf(wait, sizeof(wait), "%lld/%lld/%lld/%lld", m.wait.percentile(0.50), m.wait.percentile(0.95),
+                 m.wait.percentile(0.99), m.wait.largest());
+        snprintf(fill, sizeof(fill), "%lld/%lld", m.fillTime.percentile(0.50), m.fillTime.percentile(0.95));
+        snprintf(depth, sizeof(depth), "%lld/%lld/%lld", m.queueDepth.percentile(0.50),
+                 m.queueDepth.percentile(0.95), m.queueDepth.largest());
+        double utilization = m.busyTime / (table.taxiCount[r] * summary.duration());
+        snprintf(text, sizeof(text), "%-6c%10lld%10.4f  %-29s %-13s %-23s %5.1f%%\n", table.labels[r],
+                 m.wait.count(), m.wait.count() / summary.duration(), wait, fill, depth, 100.0 * utilization);
+        out.append(text);
+    }
+}
 
-    printTableHeader();
+// Output formats for a single run.
+enum class OutputMode { Table, Csv, Binary, Summary };
 
-    for(int timeInstance = 0; simulationActive; ++timeInstance){
-        stringstream newArrivalsStream;
+bool parseOutputMode(const string& name, OutputMode& mode) {
+    if (name == "table") mode = OutputMode::Table;
+    else if (name == "csv") mode = OutputMode::Csv;
+    else if (name == "binary") mode = OutputMode::Binary;
+    else if (name == "summary") mode = OutputMode::Summary;
+    else return false;
+    return true;
+}
 
-    // This is to check for the new arrival at each instance.
-    while(arrivalTracker < allPassengers.size() && allPassengers[arrivalTracker].arrivalTime == timeInstance){
-        Passenger p = allPassengers[arrivalTracker];
-        newArrivalsStream << p.routeType << "(" << p.boardingTime << ")";
+// Writers receive everything runSimulation reports:
+//   void begin(const RouteTable&);
+//   void arrival(const Passenger&);              - before the row of its time
+//   void unknownRoute(const Passenger&);
+//   void row(int time, const RouteTable&, const RankState&);
+//   void end(const SimulationSummary&);
+// They are template parameters, so a writer that ignores a call costs nothing.
 
-        switch(p.routeType){
-        case 'S':
-            shortTaxi.passengerQueue.push(p);
-            break;
-        case 'L':
-            longTaxi.passengerQueue.push(p);
-            break;
-        case 'C':
-            cityTaxi.passengerQueue.push(p);
-            break;
-        default:
-            cout << "Route type not found!" << endl;
-        }
-        arrivalTracker++;
+// The classic table, one row per event time.
+class TableWriter {
+public:
+    explicit TableWriter(OutputBuffer& buffer, size_t queuePreview = DEFAULT_QUEUE_PREVIEW)
+        : out(buffer), previewLimit(queuePreview) {}
+
+    void begin(const RouteTable& table) {
+        routes = &table;
+        printTableHeader(out, table);
+    }
+    void arrival(const Passenger& p) { appendPassenger(newArrivals, p); }
+    void unknownRoute(const Passenger&) { out.append("Route type not found!\n"); }
+    void row(int timeInstance, const RouteTable& table, const RankState& rank) {
+        printSimulationRow(out, timeInstance, newArrivals, table, rank, previewLimit, preview);
+        newArrivals.clear();
     }
-    processTaxiRoute(shortTaxi, 'S');
-    processTaxiRoute(longTaxi, 'L');
-    processTaxiRoute(cityTaxi, 'C');
+    void end(const SimulationSummary& summary) {
+        out.append("\nSimulation ended at time ");
+        out.appendInt(summary.endTime);
+        out.append(" - No more passengers to process.\n");
+        out.append("Events processed: ");
+        out.appendInt(summary.eventsProcessed);
+        out.put('\n');
+        printRouteReport(out, *routes, summary);
+        out.flush();
+    }
+
+private:
+    OutputBuffer& out;
+    const RouteTable* routes = nullptr;
+    size_t previewLimit;
+    string newArrivals;
+    string preview;
+};
 
-    // Step 3: Display queue and onboard info.
-    printSimulationRow(timeInstance, newArrivalsStream.str(), shortTaxi, longTaxi, cityTaxi);
+// One CSV line per event time: time, arrivals, queue length per route, then
+// free seats and status per taxi.
+class CsvWriter {
+public:
+    explicit CsvWriter(OutputBuffer& buffer) : out(buffer) {}
 
-    // Check if simulation should end.
-    if(allProcessingComplete(arrivalTracker, allPassengers)) {
-        simulationActive = false;
-        cout << "\nSimulation ended at time " << timeInstance
-             << " - No more passengers to process." << endl;
+    void begin(const RouteTable& table) {
+        out.append("time,arrivals");
+        for (int r = 0; r < table.routeCount(); r++) {
+            out.append(",queue_");
+            out.put(table.labels[r]);
+        }
+        for (int taxi = 0; taxi < table.totalTaxis(); taxi++) {
+            out.append("," + taxiColumnName("seats_", table, taxi));
+            out.append("," + taxiColumnName("status_", table, taxi));
         }
+        out.put('\n');
+    }
+    void arrival(const Passenger& p) { appendPassenger(newArrivals, p); }
+    void unknownRoute(const Passenger&) {}
+    void row(int timeInstance, const RouteTable& table, const RankState& rank) {
+        out.appendInt(timeInstance);
+        out.put(',');
+        out.append(newArrivals);
+        for (int r = 0; r < table.routeCount(); r++) {
+            out.put(',');
+            out.appendInt(rank.passengerQueues[r].size());
+        }
+        for (int taxi = 0; taxi < table.totalTaxis(); taxi++) {
+            out.put(',');
+            out.appendInt(rank.currentCapacity[taxi]);
+            out.put(',');
+            out.append(statusName(rank.status[taxi]));
+        }
+        out.put('\n');
+        newArrivals.clear();
+    }
+    void end(const SimulationSummary&) { out.flush(); }
 
-    // Safety check to prevent infinite loop.
-    if(timeInstance > 1000) {  // Adjust this value as needed.
-        cerr << "Warning: Simulation terminated after 1000 time units" << endl;
-        simulationActive = false;
+private:
+    OutputBuffer& out;
+    string newArrivals;
+};
+
+// Fixed-size little-endian records, one per event time, after a header:
+//   header: "TAXIROW\0", uint32 version, uint32 routes, uint32 taxis,
+//           then per route: uint8 routeType, uint32 taxi count
+//   record: int32 time, uint32 arrivals at that time,
+//           uint32 queue length per route, then uint16 free seats and
+//           uint8 TaxiStatus per taxi
+class BinaryRowWriter {
+public:
+    explicit BinaryRowWriter(OutputBuffer& buffer) : out(buffer) {}
+
+    void begin(const RouteTable& table) {
+        out.append("TAXIROW", 8); // Includes the terminating '\0'.
+        out.appendLittleEndian(1, 4);
+        out.appendLittleEndian(table.routeCount(), 4);
+        out.appendLittleEndian(table.totalTaxis(), 4);
+        for (int r = 0; r < table.routeCount(); r++) {
+            out.put(table.labels[r]);
+            out.appendLittleEndian(table.taxiCount[r], 4);
         }
     }
-}
+    void arrival(const Passenger&) { arrivals++; }
+    void unknownRoute(const Passenger&) {}
+    void row(int timeInstance, const RouteTable& table, const RankState& rank) {
+        out.appendLittleEndian(static_cast<uint32_t>(timeInstance), 4);
+        out.appendLittleEndian(arrivals, 4);
+        for (int r = 0; r < table.routeCount(); r++) out.appendLittleEndian(rank.passengerQueues[r].size(), 4);
+        for (int taxi = 0; taxi < table.totalTaxis(); taxi++) {
+            out.appendLittleEndian(rank.currentCapacity[taxi], 2);
+            out.appendLittleEndian(static_cast<unsigned char>(rank.status[taxi]), 1);
+        }
+        arrivals = 0;
+    }
+    void end(const SimulationSummary&) { out.flush(); }
 
-//This function is for reading the input file.
-vector<Passenger> readFileData(){
-    vector<Passenger> passengerList; // Stores TaxiData in vector.
-    const string filename = "C:\\data\\taxiData.txt"; // Hardcore path
+private:
+    OutputBuffer& out;
+    uint32_t arrivals = 0;
+};
+
+// Headless mode: nothing per event, only the summary at the end.
+class SummaryWriter {
+public:
+    explicit SummaryWriter(OutputBuffer& buffer) : out(buffer) {}
+
+    void begin(const RouteTable& table) { routes = &table; }
+    void arrival(const Passenger&) {}
+    void unknownRoute(const Passenger&) {}
+    void row(int, const RouteTable&, const RankState&) {}
+    void end(const SimulationSummary& summary) {
+        printRunSummary(out, summary);
+        printRouteReport(out, *routes, summary);
+        out.flush();
+    }
+
+private:
+    OutputBuffer& out;
+    const RouteTable* routes = nullptr;
+};
+
+// Writes nothing; used when only the summary matters, e.g. for replications.
+struct NullWriter {
+    void begin(const RouteTable&) {}
+    void arrival(const Passenger&) {}
+    void unknownRoute(const Passenger&) {}
+    void row(int, const RouteTable&, const RankState&) {}
+    void end(const SimulationSummary&) {}
+};
+
+// Whether a writer looks at the rows at all. Route shards only rebuild the
+// whole rank, time by time, for writers that do.
+template <typename Writer> struct WritesRows : true_type {};
+template <> struct WritesRows<SummaryWriter> : false_type {};
+template <> struct WritesRows<NullWriter> : false_type {};
+
+// Boarding and departure policies. The engine takes the policy as a template
+// parameter, so every hook below is resolved at compile time and inlined; a
+// hook that does nothing (as most of FifoBoarding's do) compiles to nothing.
+//
+//   static constexpr int MAX_BATCH;    - most passengers that board together
+//   void enqueue(RankState&, int route, const Passenger&);
+//                                      - a passenger joins the route queue
+//   int takePassengers(RankState&, int route, int freeSeats, Passenger* batch);
+//                                      - removes the next group to board from a
+//                                        non-empty queue and returns its size
+//   void seated(RankState&, int taxi, int seats, int time);
+//                                      - a boarding has completed; seats is the
+//                                        taxi's capacity
+//   bool departsEarly(const RankState&, int taxi, int seats, int time) const;
+//                                      - whether a taxi with free seats leaves now
+//
+// Policies may hold per-run state, so each run gets its own policy object.
+
+// Today's rules: one passenger at a time, in arrival order, and a taxi only
+// leaves when it is full.
+struct FifoBoarding {
+    static constexpr int MAX_BATCH = 1;
+
+    void enqueue(RankState& rank, int route, const Passenger& p) { rank.passengerQueues[route].push(p); }
+    int takePassengers(RankState& rank, int route, int, Passenger* batch) {
+        PassengerQueue& queue = rank.passengerQueues[route];
+        batch[0] = queue.front();
+        queue.pop();
+        return 1;
+    }
+    void seated(RankState&, int, int, int) {}
+    bool departsEarly(const RankState&, int, int, int) const { return false; }
+};
+
+// FIFO boarding, but a taxi leaves once its first passenger has been seated
+// for timeout units, full or not. A wake-up event at the deadline makes sure
+// the route is looked at then.
+struct TimeoutDeparture : FifoBoarding {
+    explicit TimeoutDeparture(int units) : timeout(units) {}
 
-    ifstream file(filename); // Initialise and open files in one step.
+    void seated(RankState& rank, int taxi, int seats, int timeInstance) {
+        if (rank.currentCapacity[taxi] != seats - 1) return; // Only the first passenger.
+        rank.firstSeatedAt[taxi] = timeInstance;
+        if (timeout > 0) rank.eventQueue.push({timeInstance + timeout, EVENT_TIMEOUT, taxi});
+    }
+    bool departsEarly(const RankState& rank, int taxi, int seats, int timeInstance) const {
+        return rank.currentCapacity[taxi] < seats && timeInstance - rank.firstSeatedAt[taxi] >= timeout;
+    }
+
+    int timeout;
+};
 
-    try{
-        if (!file.is_open()){
-            throw runtime_error("Unable to open input file." + filename);
+// Up to batchSize passengers board through the door together; the group
+// takes as long as its slowest member.
+struct BatchBoarding : FifoBoarding {
+    static constexpr int MAX_BATCH = 16;
+
+    explicit BatchBoarding(int size) : batchSize(max(1, min(size, MAX_BATCH))) {}
+
+    int takePassengers(RankState& rank, int route, int freeSeats, Passenger* batch) {
+        PassengerQueue& queue = rank.passengerQueues[route];
+        int count = 0;
+        for (int limit = min(batchSize, freeSeats); count < limit && !queue.empty(); count++) {
+            batch[count] = queue.front();
+            queue.pop();
         }
-        //Do something with each line.
-        string line;
-        while (getline(file, line)){
-            if(line.empty()) continue;
+        return count;
+    }
 
-            line.erase(remove(line.begin(), line.end(), '\r'), line.end());
+    int batchSize;
+};
 
-            stringstream ss(line);
-            string timeCount, route, boardTime;
+// Passengers flagged as priority (the optional fourth CSV field) board ahead
+// of everyone else on their route, in arrival order among themselves. They
+// stay in the route queue, so the queue displays are unchanged. Each route
+// keeps the queue positions of its waiting priority passengers, counted from
+// the first passenger ever queued, so the next one is found in O(1). Taking a
+// passenger out of the middle moves the ones ahead of it up by one.
+struct PriorityBoarding : FifoBoarding {
+    struct RouteQueueState {
+        uint64_t queued = 0;          // Position the next passenger will get.
+        uint64_t front = 0;           // Position of the passenger at the front.
+        queue<uint64_t> priority;     // Positions of waiting priority passengers, oldest first.
+    };
 
-            //Is to read comma-separated values.
-            if (!getline(ss, timeCount, ',')) continue;
-            if (!getline(ss, route, ',')) continue;
-            getline(ss, boardTime, ',');
+    explicit PriorityBoarding(const RouteTable& table) : routes(table.routeCount()) {}
 
-        try{
-            auto trim = [](string& s){
-                s.erase(s.begin(), find_if(s.begin(), s.end(), [](int ch){return !isspace(ch);}));
-                s.erase(find_if(s.rbegin(), s.rend(), [](int ch) {return !isspace(ch);}).base(), s.end());
-            };
+    void enqueue(RankState& rank, int route, const Passenger& p) {
+        RouteQueueState& state = routes[route];
+        if (p.priority) state.priority.push(state.queued);
+        state.queued++;
+        rank.passengerQueues[route].push(p);
+    }
+    int takePassengers(RankState& rank, int route, int, Passenger* batch) {
+        RouteQueueState& state = routes[route];
+        PassengerQueue& waiting = rank.passengerQueues[route];
+        size_t index = 0;
+        if (!state.priority.empty()) {
+            index = state.priority.front() - state.front;
+            state.priority.pop();
+        }
+        batch[0] = waiting.takeAt(index);
+        state.front++;
+        return 1;
+    }
 
-            trim(timeCount);
-            trim(route);
-            trim(boardTime);
+    vector<RouteQueueState> routes;
+};
 
-            int arrivalTime = stoi(timeCount); //Converting string to int.
-            char routeType = route.empty() ? '?' : route[0];
-            int boardingTime = boardTime.empty() ? 0 : stoi(boardTime); //Converting string to int.
+// Applies the boarding rules to one route at a time when it has something to do.
+// A passenger who starts boarding at time t with boarding time b takes a seat at
+// t + b (at least one time unit), and a taxi that fills up at time t is replaced by
+// an empty one at t + 1. These are the same rules as the old one-tick loop. When a
+// route has several taxis, waiting passengers go to the lowest-numbered free taxi.
+// Who boards next, how many at once and whether a taxi may leave before it is
+// full are up to the policy.
+template <typename Policy>
+void processTaxiRoute(RankState& rank, const RouteTable& table, int route, int timeInstance, Policy& policy) {
+    const int firstTaxi = table.firstTaxi[route];
+    const int lastTaxi = firstTaxi + table.taxiCount[route];
+    const int seats = table.capacity[route];
 
-            passengerList.push_back({routeType, boardingTime, arrivalTime});
-         } catch (const invalid_argument&) {
-                continue;
-            } catch (const out_of_range&) {
-                continue;
+    for (int taxi = firstTaxi; taxi < lastTaxi; taxi++) {
+        if (rank.status[taxi] == TaxiStatus::Departed && timeInstance > rank.boardingTimer[taxi]) {
+            rank.currentCapacity[taxi] = seats; // Empty taxi pulls in.
+            rank.status[taxi] = TaxiStatus::Waiting;
+            rank.pulledInAt[taxi] = timeInstance;
+        }
+
+        bool seated = false;
+        if (rank.isBoarding[taxi] && timeInstance >= rank.boardingTimer[taxi]) {
+            rank.currentCapacity[taxi] -= Policy::MAX_BATCH > 1 ? rank.boardingCount[taxi] : 1; // Decrease capacity.
+            rank.status[taxi] = TaxiStatus::Board;    // Set status to Board.
+            rank.isBoarding[taxi] = 0;
+            rank.activeBoardings--;
+            policy.seated(rank, taxi, seats, timeInstance);
+            seated = true;
+        }
+
+        bool full = seated && rank.currentCapacity[taxi] <= 0;   // Check if taxi is full.
+        if (full || (rank.status[taxi] == TaxiStatus::Board && !rank.isBoarding[taxi] &&
+                     policy.departsEarly(rank, taxi, seats, timeInstance))) {
+            rank.status[taxi] = TaxiStatus::Departed;
+            rank.boardingTimer[taxi] = timeInstance;
+            rank.departures++;
+            rank.routeMetrics[route].departures++;
+            rank.routeMetrics[route].fillTime.record(timeInstance - rank.pulledInAt[taxi]);
+            rank.eventQueue.push({timeInstance + 1, EVENT_DEPARTURE, taxi});
+        }
+    }
+
+    PassengerQueue& passengerQueue = rank.passengerQueues[route];
+    for (int taxi = firstTaxi; taxi < lastTaxi && !passengerQueue.empty(); taxi++) {
+        if (!rank.isBoarding[taxi] && rank.currentCapacity[taxi] > 0 && rank.status[taxi] != TaxiStatus::Departed) {
+            Passenger group[Policy::MAX_BATCH];
+            int count = policy.takePassengers(rank, route, rank.currentCapacity[taxi], group);
+            int firstSeat = rank.onBoardOffset[taxi] + seats - rank.currentCapacity[taxi];
+            int boardingDuration = 1;
+            for (int i = 0; i < count; i++) {
+                const Passenger& next = group[i];
+                int wait = timeInstance - next.arrivalTime;
+                boardingDuration = max(boardingDuration, next.boardingTime);
+                rank.totalWait += wait;
+                rank.routeMetrics[route].wait.record(wait);
+                rank.onBoardSeats[firstSeat + i] = next;
             }
+            rank.currentBoardingPassenger[taxi] = group[count - 1];
+            if (Policy::MAX_BATCH > 1) rank.boardingCount[taxi] = count;
+            rank.passengersBoarded += count;
+            rank.waitingPassengers -= count;
+            rank.routeMetrics[route].busyTime += boardingDuration;
+            rank.boardingTimer[taxi] = timeInstance + boardingDuration;
+            rank.isBoarding[taxi] = 1;
+            rank.activeBoardings++;
+            rank.eventQueue.push({rank.boardingTimer[taxi], EVENT_BOARDING_COMPLETE, taxi});
         }
-    } catch (const exception& e) {
-        if (file.is_open()) file.close();
-        cerr << "Error: " << e.what() << endl;
-        throw;
     }
+}
 
-    return passengerList;
+void processTaxiRoute(RankState& rank, const RouteTable& table, int route, int timeInstance) {
+    FifoBoarding fifo;
+    processTaxiRoute(rank, table, route, timeInstance, fifo);
 }
 
-int main() {
-    try {
-        vector<Passenger> allPassengers = readFileData();
-        runSimulation(allPassengers);
-    } catch (const exception& e) {
-        cerr << "Fatal error: " << e.what() << endl;
-        return 1;
+// Boarding policy picked on the command line.
+enum class PolicyKind { Fifo, Timeout, Batch, Priority };
+
+struct PolicyChoice {
+    PolicyKind kind = PolicyKind::Fifo;
+    int parameter = 0;   // Timeout in time units, or batch size.
+};
+
+// "fifo", "timeout:<units>", "batch:<size>" or "priority".
+bool parsePolicy(const string& text, PolicyChoice& choice) {
+    string kind = text.substr(0, text.find(':'));
+    string value = kind.size() < text.size() ? text.substr(kind.size() + 1) : "";
+    if (kind == "fifo" || kind == "priority") {
+        choice.kind = kind == "fifo" ? PolicyKind::Fifo : PolicyKind::Priority;
+        return value.empty();
+    }
+    if (kind != "timeout" && kind != "batch") return false;
+    choice.kind = kind == "timeout" ? PolicyKind::Timeout : PolicyKind::Batch;
+    choice.parameter = atoi(value.c_str());
+    return choice.parameter >= 1 && (kind == "timeout" || choice.parameter <= BatchBoarding::MAX_BATCH);
+}
+
+// Calls run(policy) with a fresh policy object of the chosen type. Each type
+// gets its own instantiation of the engine.
+template <typename Run>
+SimulationSummary withPolicy(const PolicyChoice& choice, const RouteTable& table, Run run) {
+    switch (choice.kind) {
+    case PolicyKind::Timeout: {
+        TimeoutDeparture policy(choice.parameter);
+        return run(policy);
+    }
+    case PolicyKind::Batch: {
+        BatchBoarding policy(choice.parameter);
+        return run(policy);
+    }
+    case PolicyKind::Priority: {
+        PriorityBoarding policy(table);
+        return run(policy);
+    }
+    default: {
+        FifoBoarding policy;
+        return run(policy);
+    }
+    }
+}
+
+// Arrival sources feed runSimulation one passenger at a time, in trace order:
+//   bool done() const;              - no passengers left
+//   const Passenger& peek() const;  - next passenger (only when !done())
+//   void advance();                 - move past it
+// This one walks a trace that is already loaded into memory.
+class VectorArrivalSource {
+public:
+    explicit VectorArrivalSource(const vector<Passenger>& passengers) : passengerList(passengers) {}
+
+    bool done() const { return arrivalTracker >= passengerList.size(); }
+    const Passenger& peek() const { return passengerList[arrivalTracker]; }
+    void advance() { arrivalTracker++; }
+
+private:
+    const vector<Passenger>& passengerList;
+    size_t arrivalTracker = 0; // To track passengers already added.
+};
+
+// Wraps another arrival source and multiplies every boarding time by a factor
+// (rounded to the nearest unit), so what-if runs can share one loaded trace.
+template <typename ArrivalSource>
+class ScaledArrivalSource {
+public:
+    ScaledArrivalSource(ArrivalSource& source, double boardingScale) : inner(source), scale(boardingScale) { load(); }
+
+    bool done() const { return inner.done(); }
+    const Passenger& peek() const { return current; }
+    void advance() {
+        inner.advance();
+        load();
+    }
+
+private:
+    void load() {
+        if (inner.done()) return;
+        current = inner.peek();
+        current.boardingTime = static_cast<int>(lround(current.boardingTime * scale));
+    }
+
+    ArrivalSource& inner;
+    double scale;
+    Passenger current = {'?', 0, 0, 0};
+};
+
+// Checkpoint file format (version 2). All integers are little-endian; signed
+// values are stored as their two's complement bit pattern.
+//
+//   magic "TAXICKP\0", uint32 version
+//   route table shape:   uint32 routes, then per route uint8 label, uint32 taxis, uint32 capacity
+//   clock:               uint8 started, int32 last time processed
+//   summary totals:      int32 startTime, int64 events, arrived, unknown route, peak queue,
+//                        float64 queue length area
+//   rank totals:         int64 waiting, active boardings, boarded, total wait, departures
+//   per taxi:            uint8 status, uint8 boarding, int32 timer, int32 free seats,
+//                        passenger being boarded, int32 pulled in at,
+//                        int32 passengers in the group being boarded,
+//                        int32 first passenger seated at
+//   seats:               every seat slot in taxi order, as passengers
+//   per route queue:     uint64 length, then the waiting passengers front first
+//   events:              uint64 count, then int32 time, uint8 type, int32 taxi
+//   per route metrics:   wait, fill time and queue depth histograms, int64 busy time, departures
+//
+// A passenger is uint8 routeType, int32 boardingTime, int32 arrivalTime.
+// The file holds only the in-flight state, so its size follows the number of
+// waiting passengers, not the length of the trace.
+const char CHECKPOINT_MAGIC[8] = {'T', 'A', 'X', 'I', 'C', 'K', 'P', '\0'};
+const uint32_t CHECKPOINT_VERSION = 2;
+
+struct CheckpointWriter {
+    string bytes;
+
+    void put(uint64_t value, int width) {
+        for (int i = 0; i < width; i++) bytes.push_back(static_cast<char>(value >> (8 * i)));
+    }
+    void putSigned(long long value, int width) { put(static_cast<uint64_t>(value), width); }
+    void putPassenger(const Passenger& p) {
+        put(static_cast<unsigned char>(p.routeType), 1);
+        putSigned(p.boardingTime, 4);
+        putSigned(p.arrivalTime, 4);
+    }
+};
+
+struct CheckpointReader {
+    const unsigned char* cursor;
+    const unsigned char* end;
+
+    uint64_t get(int width) {
+        if (end - cursor < width) throw runtime_error("Checkpoint file is truncated.");
+        uint64_t value = 0;
+        for (int i = 0; i < width; i++) value |= static_cast<uint64_t>(cursor[i]) << (8 * i);
+        cursor += width;
+        return value;
+    }
+    int getInt() { return static_cast<int32_t>(static_cast<uint32_t>(get(4))); }
+    Passenger getPassenger() {
+        Passenger p;
+        p.routeType = static_cast<char>(get(1));
+        p.boardingTime = getInt();
+        p.arrivalTime = getInt();
+        return p;
+    }
+};
+
+void writeCheckpoint(const string& filename, const RouteTable& table, const SimulationState& state) {
+    const RankState& rank = state.rank;
+    const SimulationSummary& summary = state.summary;
+    CheckpointWriter out;
+    out.bytes.assign(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    out.put(CHECKPOINT_VERSION, 4);
+
+    out.put(table.routeCount(), 4);
+    for (int r = 0; r < table.routeCount(); r++) {
+        out.put(static_cast<unsigned char>(table.labels[r]), 1);
+        out.put(table.taxiCount[r], 4);
+        out.put(table.capacity[r], 4);
+    }
+
+    out.put(state.started, 1);
+    out.putSigned(state.previousTime, 4);
+
+    out.putSigned(summary.startTime, 4);
+    out.putSigned(rank.eventsProcessed, 8);
+    out.putSigned(summary.passengersArrived, 8);
+    out.putSigned(summary.unknownRoutePassengers, 8);
+    out.put(summary.peakQueueLength, 8);
+    uint64_t areaBits;
+    memcpy(&areaBits, &summary.queueLengthArea, sizeof(areaBits));
+    out.put(areaBits, 8);
+
+    out.put(rank.waitingPassengers, 8);
+    out.putSigned(rank.activeBoardings, 8);
+    out.putSigned(rank.passengersBoarded, 8);
+    out.putSigned(rank.totalWait, 8);
+    out.putSigned(rank.departures, 8);
+
+    for (int taxi = 0; taxi < table.totalTaxis(); taxi++) {
+        out.put(static_cast<unsigned char>(rank.status[taxi]), 1);
+        out.put(rank.isBoarding[taxi], 1);
+        out.putSigned(rank.boardingTimer[taxi], 4);
+        out.putSigned(rank.currentCapacity[taxi], 4);
+        out.putPassenger(rank.currentBoardingPassenger[taxi]);
+        out.putSigned(rank.pulledInAt[taxi], 4);
+        out.putSigned(rank.boardingCount[taxi], 4);
+        out.putSigned(rank.firstSeatedAt[taxi], 4);
+    }
+    for (const Passenger& p : rank.onBoardSeats) out.putPassenger(p);
+
+    for (const PassengerQueue& q : rank.passengerQueues) {
+        out.put(q.size(), 8);
+        for (const Passenger& p : q) out.putPassenger(p);
+    }
+
+    // The queue only exposes its top, so drain a copy; it holds a few events per taxi.
+    auto events = rank.eventQueue;
+    out.put(events.size(), 8);
+    for (; !events.empty(); events.pop()) {
+        out.putSigned(events.top().time, 4);
+        out.put(events.top().type, 1);
+        out.putSigned(events.top().taxiIndex, 4);
+    }
+
+    for (const RouteMetrics& metrics : rank.routeMetrics) {
+        metrics.wait.save(out);
+        metrics.fillTime.save(out);
+        metrics.queueDepth.save(out);
+        out.putSigned(metrics.busyTime, 8);
+        out.putSigned(metrics.departures, 8);
+    }
+
+    // Write to a temporary name and rename, so a crash never leaves a torn checkpoint.
+    string partial = filename + ".partial";
+    {
+        ofstream file(partial, ios::binary | ios::trunc);
+        if (!file.is_open()) throw runtime_error("Unable to open checkpoint file. " + partial);
+        file.write(out.bytes.data(), out.bytes.size());
+        if (!file) throw runtime_error("Failed while writing checkpoint file. " + partial);
+    }
+    remove(filename.c_str());
+    if (rename(partial.c_str(), filename.c_str()) != 0) {
+        throw runtime_error("Unable to rename checkpoint file. " + filename);
     }
-    return 0;
 }
 
+// Reads a checkpoint taken with the same route table.
+SimulationState readCheckpoint(const string& filename, const RouteTable& table) {
+    ifstream file(filename, ios::binary);
+    if (!file.is_open()) throw runtime_error("Unable to open checkpoint file. " + filename);
+    string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    CheckpointReader in{reinterpret_cast<const unsigned char*>(bytes.data()),
+                        reinterpret_cast<const unsigned char*>(bytes.data()) + bytes.size()};
+
+    if (bytes.size() < sizeof(CHECKPOINT_MAGIC) || memcmp(bytes.data(), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+        throw runtime_error("Not a checkpoint file. " + filename);
+    }
+    in.cursor += sizeof(CHECKPOINT_MAGIC);
+    uint64_t version = in.get(4);
+    if (version != CHECKPOINT_VERSION) {
+        throw runtime_error("Unsupported checkpoint version. " + filename);
+    }
+
+    bool sameTable = in.get(4) == static_cast<uint64_t>(table.routeCount());
+    for (int r = 0; sameTable && r < table.routeCount(); r++) {
+        sameTable = in.get(1) == static_cast<unsigned char>(table.labels[r]) &&
+                    in.get(4) == static_cast<uint64_t>(table.taxiCount[r]) &&
+                    in.get(4) == static_cast<uint64_t>(table.capacity[r]);
+    }
+    if (!sameTable) throw runtime_error("Checkpoint was taken with a different route table. " + filename);
+
+    SimulationState state(table);
+    RankState& rank = state.rank;
+    SimulationSummary& summary = state.summary;
+
+    state.restored = true;
+    state.started = in.get(1) != 0;
+    state.previousTime = in.getInt();
+
+    summary.startTime = in.getInt();
+    rank.eventsProcessed = in.get(8);
+    summary.passengersArrived = in.get(8);
+    summary.unknownRoutePassengers = in.get(8);
+    summary.peakQueueLength = in.get(8);
+    uint64_t areaBits = in.get(8);
+    memcpy(&summary.queueLengthArea, &areaBits, sizeof(areaBits));
+
+    rank.waitingPassengers = in.get(8);
+    rank.activeBoardings = static_cast<int>(in.get(8));
+    rank.passengersBoarded = in.get(8);
+    rank.totalWait = in.get(8);
+    rank.departures = in.get(8);
+
+    for (int taxi = 0; taxi < table.totalTaxis(); taxi++) {
+        uint64_t status = in.get(1);
+        if (status > static_cast<uint64_t>(TaxiStatus::Departed)) throw runtime_error("Corrupt taxi status in checkpoint.");
+        rank.status[taxi] = static_cast<TaxiStatus>(status);
+        rank.isBoarding[taxi] = static_cast<unsigned char>(in.get(1));
+        rank.boardingTimer[taxi] = in.getInt();
+        rank.currentCapacity[taxi] = in.getInt();
+        rank.currentBoardingPassenger[taxi] = in.getPassenger();
+        rank.pulledInAt[taxi] = in.getInt();
+        rank.boardingCount[taxi] = in.getInt();
+        rank.firstSeatedAt[taxi] = in.getInt();
+        int seats = table.capacity[table.taxiRoute[taxi]];
+        if (rank.currentCapacity[taxi] < 0 || rank.currentCapacity[taxi] > seats || rank.boardingCount[taxi] < 1 ||
+            (rank.isBoarding[taxi] && rank.boardingCount[taxi] > rank.currentCapacity[taxi])) {
+            throw runtime_error("Corrupt taxi state in checkpoint.");
+        }
+    }
+    for (Passenger& p : rank.onBoardSeats) p = in.getPassenger();
+
+    for (PassengerQueue& q : rank.passengerQueues) {
+        uint64_t length = in.get(8);
+        if (length > static_cast<uint64_t>(in.end - in.cursor) / 9) throw runtime_error("Checkpoint file is truncated.");
+        for (uint64_t i = 0; i < length; i++) q.push(in.getPassenger());
+    }
+
+    for (uint64_t events = in.get(8); events > 0; events--) {
+        SimulationEvent event;
+        event.time = in.getInt();
+        event.type = static_cast<EventType>(in.get(1));
+        event.taxiIndex = in.getInt();
+        if (event.taxiIndex < 0 || event.taxiIndex >= table.totalTaxis()) {
+            throw runtime_error("Corrupt event in checkpoint.");
+        }
+        rank.eventQueue.push(event);
+    }
+
+    for (RouteMetrics& metrics : rank.routeMetrics) {
+        metrics.wait.load(in);
+        metrics.fillTime.load(in);
+        metrics.queueDepth.load(in);
+        metrics.busyTime = in.get(8);
+        metrics.departures = in.get(8);
+    }
+    return state;
+}
+
+// When to take automatic checkpoints: at the first time instance at or after
+// every multiple of interval. An interval of 0 takes none.
+struct CheckpointSchedule {
+    int interval = 0;
+    string prefix = "taxi";
+
+    string filename(int timeInstance) const { return prefix + "-" + to_string(timeInstance) + ".ckpt"; }
+};
+
+// Jumps from one event time to the next instead of stepping one time unit at a
+// time, so the cost depends on the number of events and not on the length of the
+// simulated day. The writer gets a row for every time at which something happened.
+// All state is local, so independent runs may execute on different threads.
+//
+// Runs the simulation on from state until every passenger has boarded. The
+// arrival source is read from its start; on a restored state, passengers up
+// to the checkpointed time are already in the rank and are skipped (traces
+// are in arrival order, so these are exactly the ones read before).
+template <typename ArrivalSource, typename Writer, typename Policy>
+SimulationSummary continueSimulation(ArrivalSource& arrivals, const RouteTable& table, Writer& writer,
+                                     SimulationState& state, const CheckpointSchedule& checkpoints, Policy& policy) {
+    RankState& rank = state.rank;
+    SimulationSummary& summary = state.summary;
+    bool& started = state.started;
+    int& previousTime = state.previousTime;
+    if (state.restored) {
+        while (!arrivals.done() && arrivals.peek().arrivalTime <= previousTime) arrivals.advance();
+    }
+    long long nextCheckpoint = LLONG_MAX;
+    if (checkpoints.interval > 0 && started) {
+        nextCheckpoint = (previousTime / checkpoints.interval + 1LL) * checkpoints.interval;
+    }
+
+    bool completed = false;
+
+    // Routes with something to do at the current time, without rescanning every route.
+    vector<int> dueRoutes;
+    vector<unsigned char> routeDue(table.routeCount(), 0);
+    auto markDue = [&](int route) {
+        if (!routeDue[route]) {
+            routeDue[route] = 1;
+            dueRoutes.push_back(route);
+        }
+    };
+
+    writer.begin(table);
+
+    while (!arrivals.done() || !rank.eventQueue.empty()) {
+        // The next time instance is the earliest pending arrival or route event.
+        int timeInstance = rank.eventQueue.empty() ? arrivals.peek().arrivalTime : rank.eventQueue.top().time;
+        if (!arrivals.done()) {
+            timeInstance = min(timeInstance, arrivals.peek().arrivalTime);
+        }
+        if (!started) {
+            state.startAt(timeInstance);
+            if (checkpoints.interval > 0) {
+                nextCheckpoint = (timeInstance / checkpoints.interval + 1LL) * checkpoints.interval;
+            }
+        }
+        summary.queueLengthArea += static_cast<double>(rank.waitingPassengers) * (timeInstance - previousTime);
+        previousTime = timeInstance;
+
+        // Passengers listed out of order are treated as arriving now.
+        while (!arrivals.done() && arrivals.peek().arrivalTime <= timeInstance) {
+            const Passenger& p = arrivals.peek();
+            writer.arrival(p);
+
+            int route = table.routeIndex(p.routeType);
+            if (route >= 0) {
+                policy.enqueue(rank, route, p);
+                rank.waitingPassengers++;
+                rank.routeMetrics[route].queueDepth.record(rank.passengerQueues[route].size());
+                markDue(route);
+            } else {
+                summary.unknownRoutePassengers++;
+                writer.unknownRoute(p);
+            }
+            summary.passengersArrived++;
+            arrivals.advance();
+            rank.eventsProcessed++;
+        }
+        summary.peakQueueLength = max(summary.peakQueueLength, rank.waitingPassengers);
+
+        while (!rank.eventQueue.empty() && rank.eventQueue.top().time == timeInstance) {
+            markDue(table.taxiRoute[rank.eventQueue.top().taxiIndex]);
+            rank.eventQueue.pop();
+            rank.eventsProcessed++;
+        }
+
+        for (int route : dueRoutes) {
+            processTaxiRoute(rank, table, route, timeInstance, policy);
+            routeDue[route] = 0;
+        }
+        dueRoutes.clear();
+
+        writer.row(timeInstance, table, rank);
+
+        // Check if simulation should end. A taxi that filled on the last
+        // boarding still has its departure queued; it is simply dropped.
+        if (allProcessingComplete(arrivals.done(), rank)) {
+            if (!completed) summary.endTime = timeInstance;
+            completed = true;
+            if (!state.drainEvents) break;
+        }
+
+        if (timeInstance >= nextCheckpoint) {
+            writeCheckpoint(checkpoints.filename(timeInstance), table, state);
+            nextCheckpoint = (timeInstance / checkpoints.interval + 1LL) * checkpoints.interval;
+        }
+    }
+
+    summary.eventsProcessed = rank.eventsProcessed;
+    summary.passengersBoarded = rank.passengersBoarded;
+    summary.totalWait = rank.totalWait;
+    summary.departures = rank.departures;
+    for (const RouteMetrics& metrics : rank.routeMetrics) summary.waitHistogram.merge(metrics.wait);
+    summary.routeMetrics.swap(rank.routeMetrics);
+    writer.end(summary);
+    return summary;
+}
+
+template <typename ArrivalSource, typename Writer>
+SimulationSummary continueSimulation(ArrivalSource& arrivals, const RouteTable& table, Writer& writer,
+                                     SimulationState& state, const CheckpointSchedule& checkpoints = CheckpointSchedule()) {
+    FifoBoarding fifo;
+    return continueSimulation(arrivals, table, writer, state, checkpoints, fifo);
+}
+
+template <typename ArrivalSource, typename Writer>
+SimulationSummary runSimulation(ArrivalSource& arrivals, const RouteTable& table, Writer& writer) {
+    SimulationState state(table);
+    return continueSimulation(arrivals, table, writer, state);
+}
+
+// Read-only memory mapping of a whole file. The trace is parsed straight out of
+// the mapping, so no line or field is ever copied into a temporary string.
+class MappedFile {
+public:
+    explicit MappedFile(const string& filename) {
+#ifdef _WIN32
+        fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                 OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            throw runtime_error("Unable to open input file. " + filename);
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(fileHandle, &fileSize);
+        length = static_cast<size_t>(fileSize.QuadPart);
+        if (length > 0) {
+            mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mappingHandle != NULL) {
+                bytes = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+            }
+            if (bytes == nullptr) {
+                close();
+                throw runtime_error("Unable to map input file. " + filename);
+            }
+        }
+#else
+        fileDescriptor = open(filename.c_str(), O_RDONLY);
+        if (fileDescriptor < 0) {
+            throw runtime_error("Unable to open input file. " + filename);
+        }
+        struct stat fileInfo;
+        if (fstat(fileDescriptor, &fileInfo) != 0) {
+            close();
+            throw runtime_error("Unable to read size of input file. " + filename);
+        }
+        length = static_cast<size_t>(fileInfo.st_size);
+        if (length > 0) {
+            void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+            if (mapping == MAP_FAILED) {
+                close();
+                throw runtime_error("Unable to map input file. " + filename);
+            }
+            bytes = static_cast<const char*>(mapping);
+            madvise(mapping, length, MADV_SEQUENTIAL); // Hint for read-ahead; failure is harmless.
+        }
+#endif
+    }
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    void close() {
+#ifdef _WIN32
+        if (bytes != nullptr) UnmapViewOfFile(bytes);
+        if (mappingHandle != NULL) CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (bytes != nullptr) munmap(const_cast<char*>(bytes), length);
+        if (fileDescriptor >= 0) ::close(fileDescriptor);
+        fileDescriptor = -1;
+#endif
+        bytes = nullptr;
+    }
+
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = NULL;
+#else
+    int fileDescriptor = -1;
+#endif
+};
+
+// Summary of one trace load, reported next to the simulation output.
+struct TraceLoadStats {
+    size_t bytesRead = 0;
+    size_t rowsAccepted = 0;
+    size_t rowsRejected = 0;
+    double seconds = 0.0;
+};
+
+// memchr over [from, to); returns nullptr when the range is empty or has no match.
+inline const char* findByte(const char* from, const char* to, char byte) {
+    if (from >= to) return nullptr;
+    return static_cast<const char*>(memchr(from, byte, static_cast<size_t>(to - from)));
+}
+
+inline bool isFieldSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Parses an optionally signed decimal integer in [p, end) in place, in the spirit
+// of from_chars: no allocation, no locale and no exceptions. Leading and trailing
+// blanks are skipped; anything else left in the field makes the parse fail.
+bool parseIntField(const char* p, const char* end, int& value) {
+    while (p < end && isFieldSpace(*p)) p++;
+    while (end > p && isFieldSpace(end[-1])) end--;
+    if (p == end) return false;
+
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = (*p == '-');
+        if (++p == end) return false;
+    }
+    long long result = 0;
+    for (; p < end; p++) {
+        unsigned digit = static_cast<unsigned char>(*p) - '0';
+        if (digit > 9) return false;
+        result = result * 10 + digit;
+        if (result > INT_MAX) return false; // Out of range, like stoi would report.
+    }
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+// Parses one "arrivalTime,routeType,boardingTime[,priority]" row. A missing or blank
+// boarding time counts as 0, as it always has.
+bool parsePassengerRow(const char* line, const char* lineEnd, Passenger& passenger) {
+    const char* firstComma = findByte(line, lineEnd, ',');
+    if (firstComma == nullptr) return false;
+    const char* routeStart = firstComma + 1;
+    const char* secondComma = findByte(routeStart, lineEnd, ',');
+    const char* routeEnd = secondComma != nullptr ? secondComma : lineEnd;
+
+    if (!parseIntField(line, firstComma, passenger.arrivalTime)) return false;
+
+    while (routeStart < routeEnd && isFieldSpace(*routeStart)) routeStart++;
+    passenger.routeType = routeStart < routeEnd ? *routeStart : '?';
+
+    passenger.boardingTime = 0;
+    passenger.priority = 0;
+    if (secondComma != nullptr) {
+        const char* boardStart = secondComma + 1;
+        const char* boardEnd = findByte(boardStart, lineEnd, ',');
+        if (boardEnd == nullptr) boardEnd = lineEnd;
+        const char* firstNonBlank = boardStart;
+        while (firstNonBlank < boardEnd && isFieldSpace(*firstNonBlank)) firstNonBlank++;
+        if (firstNonBlank < boardEnd && !parseIntField(firstNonBlank, boardEnd, passenger.boardingTime)) {
+            return false;
+        }
+
+        // Optional fourth field: a non-zero number marks a priority passenger. A
+        // blank one counts as 0; anything else that isn't a number rejects the row.
+        int priority = 0;
+        if (boardEnd < lineEnd) {
+            const char* priorityStart = boardEnd + 1;
+            const char* priorityEnd = findByte(priorityStart, lineEnd, ',');
+            if (priorityEnd == nullptr) priorityEnd = lineEnd;
+            while (priorityStart < priorityEnd && isFieldSpace(*priorityStart)) priorityStart++;
+            if (priorityStart < priorityEnd && !parseIntField(priorityStart, priorityEnd, priority)) return false;
+            passenger.priority = priority != 0;
+        }
+    }
+    return true;
+}
+
+// Fast path for the canonical "12,S,3" row with no blanks. It reads each byte
+// once and, on success, leaves cursor at the start of the next line. Anything
+// unusual returns false with cursor untouched so the general parser can decide.
+inline bool parseCompactRow(const char*& cursor, const char* fileEnd, Passenger& passenger) {
+    const char* p = cursor;
+    unsigned arrival = 0;
+    const char* digitsStart = p;
+    while (p < fileEnd && static_cast<unsigned char>(*p - '0') <= 9 && p - digitsStart < 9) {
+        arrival = arrival * 10 + (*p++ - '0');
+    }
+    if (p == digitsStart || fileEnd - p < 4 || p[0] != ',' || p[2] != ',') return false;
+    char route = p[1];
+    if (isFieldSpace(route) || route == ',' || route == '\n') return false;
+    p += 3;
+
+    unsigned boarding = 0;
+    digitsStart = p;
+    while (p < fileEnd && static_cast<unsigned char>(*p - '0') <= 9 && p - digitsStart < 9) {
+        boarding = boarding * 10 + (*p++ - '0');
+    }
+    if (p == digitsStart) return false;
+    if (p < fileEnd && *p == '\r') p++;
+    if (p < fileEnd && *p++ != '\n') return false;
+
+    passenger.arrivalTime = static_cast<int>(arrival);
+    passenger.routeType = route;
+    passenger.boardingTime = static_cast<int>(boarding);
+    passenger.priority = 0;
+    cursor = p;
+    return true;
+}
+
+// Reads CSV rows from cursor until one parses into passenger, leaving cursor
+// at the start of the following row. Returns false once [cursor, fileEnd) is
+// used up. Rows that cannot be parsed are counted in stats.rowsRejected
+// instead of stopping the load.
+inline bool parseNextRow(const char*& cursor, const char* fileEnd, TraceLoadStats& stats, Passenger& passenger) {
+    while (cursor < fileEnd) {
+        if (parseCompactRow(cursor, fileEnd, passenger)) {
+            stats.rowsAccepted++;
+            return true;
+        }
+
+        const char* lineEnd = findByte(cursor, fileEnd, '\n');
+        if (lineEnd == nullptr) lineEnd = fileEnd;
+        const char* line = cursor;
+        cursor = lineEnd < fileEnd ? lineEnd + 1 : fileEnd;
+
+        const char* firstNonBlank = line;
+        while (firstNonBlank < lineEnd && isFieldSpace(*firstNonBlank)) firstNonBlank++;
+        if (firstNonBlank == lineEnd) continue; // Blank lines are skipped, not rejected.
+        if (parsePassengerRow(line, lineEnd, passenger)) {
+            stats.rowsAccepted++;
+            return true;
+        }
+        stats.rowsRejected++;
+    }
+    return false;
+}
+
+// Parses the CSV rows in [cursor, fileEnd) and hands each passenger to
+// accept(passenger).
+template <typename Accept>
+void parseRows(const char* cursor, const char* fileEnd, TraceLoadStats& stats, Accept accept) {
+    Passenger passenger;
+    while (parseNextRow(cursor, fileEnd, stats, passenger)) accept(passenger);
+}
+
+// Parses a mapped CSV trace in place.
+vector<Passenger> parseTrace(const MappedFile& file, TraceLoadStats& stats) {
+    auto loadStart = chrono::steady_clock::now();
+    const char* fileStart = file.data();
+    const char* fileEnd = fileStart + file.size();
+
+    // Count lines first so the passenger list is allocated exactly once.
+    size_t lineCount = 1;
+    for (const char* p = fileStart; p < fileEnd; p++) {
+        p = findByte(p, fileEnd, '\n');
+        if (p == nullptr) break;
+        lineCount++;
+    }
+
+    vector<Passenger> passengerList; // Stores TaxiData in vector.
+    passengerList.reserve(file.size() > 0 ? lineCount : 0);
+    parseRows(fileStart, fileEnd, stats, [&](const Passenger& p) { passengerList.push_back(p); });
+
+    stats.bytesRead = file.size();
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+    return passengerList;
+}
+
+//This function is for reading the input file.
+vector<Passenger> readFileData(const string& filename, TraceLoadStats& stats) {
+    MappedFile file(filename); // Throws if the file cannot be opened.
+    return parseTrace(file, stats);
+}
+
+void printLoadSummary(const string& filename, const TraceLoadStats& stats) {
+    double megabytes = stats.bytesRead / (1024.0 * 1024.0);
+    cerr << "Loaded " << stats.rowsAccepted << " passengers from " << filename
+         << " (" << stats.rowsRejected << " rejected rows, " << fixed << setprecision(2)
+         << megabytes << " MB in " << stats.seconds * 1000.0 << " ms";
+    if (stats.seconds > 0.0) cerr << ", " << megabytes / stats.seconds << " MB/s";
+    cerr << ")" << defaultfloat << endl;
+}
+
+// Bounded lock-free ring for one producer thread and one consumer thread. Each
+// side owns one index and publishes it with a release store; each also keeps
+// a cached copy of the other side's index and only reloads it when the ring
+// looks full (or empty), so in steady state the two cores rarely share a line.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    // Producer side. Returns false when the ring is full; the item is only
+    // moved from when it is pushed.
+    template <typename Item>
+    bool tryPush(Item&& item) {
+        size_t tail = tailIndex.load(memory_order_relaxed);
+        if (tail - cachedHead == slots.size()) {
+            cachedHead = headIndex.load(memory_order_acquire);
+            if (tail - cachedHead == slots.size()) return false;
+        }
+        slots[tail & mask] = forward<Item>(item);
+        tailIndex.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    // Consumer side. The oldest item, or nullptr when the ring is empty.
+    T* front() {
+        size_t head = headIndex.load(memory_order_relaxed);
+        if (head == cachedTail) {
+            cachedTail = tailIndex.load(memory_order_acquire);
+            if (head == cachedTail) return nullptr;
+        }
+        return &slots[head & mask];
+    }
+
+    void pop() { headIndex.store(headIndex.load(memory_order_relaxed) + 1, memory_order_release); }
+
+    size_t capacity() const { return slots.size(); }
+
+private:
+    vector<T> slots;
+    size_t mask = 0;
+    alignas(64) atomic<size_t> headIndex{0};
+    size_t cachedTail = 0;   // Consumer's copy of tailIndex.
+    alignas(64) atomic<size_t> tailIndex{0};
+    size_t cachedHead = 0;   // Producer's copy of headIndex.
+};
+
+// Waiting step for a thread whose ring is full or empty: yield at first, then
+// sleep briefly so a long wait does not burn a core.
+inline void backOff(int idle) {
+    if (idle < 64) this_thread::yield();
+    else this_thread::sleep_for(chrono::microseconds(50));
+}
+
+const size_t DEFAULT_STREAM_WINDOW = 1 << 16;
+
+// Arrival source fed by a reader thread. The thread reads the CSV trace from a
+// file or standard input ("-") in fixed-size blocks, parses whole lines and
+// pushes the passengers into a bounded ring; the simulation takes them as its
+// clock reaches them. Memory is the ring plus one read block, whatever the
+// length of the trace, and the run starts as soon as the first rows are in.
+// When the ring is empty the simulation waits for the reader, so a live pipe
+// (e.g. rank sensors) drives the simulation as its rows come in. The reader
+// waits for input with a timeout, so a run that stops early (or fails) does not
+// hang on a pipe that has nothing more to say.
+extern const char BINARY_TRACE_MAGIC[8]; // See the binary trace format below.
+
+class StreamArrivalSource {
+public:
+    StreamArrivalSource(const string& filename, size_t window) : ring(window) {
+        if (filename == "-") {
+            input = stdin;
+        } else {
+            input = fopen(filename.c_str(), "rb");
+            if (input == nullptr) throw runtime_error("Unable to open file. " + filename);
+            ownsInput = true;
+        }
+        reader = thread([this]() { readAll(); });
+    }
+
+    ~StreamArrivalSource() {
+        stopRequested.store(true);
+        reader.join();
+        if (ownsInput) fclose(input);
+    }
+
+    StreamArrivalSource(const StreamArrivalSource&) = delete;
+    StreamArrivalSource& operator=(const StreamArrivalSource&) = delete;
+
+    // Waits until the next passenger is available or the input has ended.
+    bool done() {
+        if (current != nullptr) return false;
+        for (int idle = 0;; idle++) {
+            current = ring.front();
+            if (current != nullptr) return false;
+            if (finished.load(memory_order_acquire)) {
+                current = ring.front(); // Rows pushed just before the reader finished.
+                if (current != nullptr) return false;
+                if (readerError) rethrow_exception(readerError);
+                return true;
+            }
+            backOff(idle);
+        }
+    }
+
+    const Passenger& peek() {
+        if (current == nullptr) done();
+        return *current;
+    }
+
+    void advance() {
+        ring.pop();
+        current = nullptr;
+    }
+
+    // Valid once done() has returned true.
+    const TraceLoadStats& stats() const { return loadStats; }
+
+private:
+    static const size_t READ_BLOCK = 1 << 20;
+
+    void readAll() {
+        try {
+            auto loadStart = chrono::steady_clock::now();
+            vector<char> block(READ_BLOCK);
+            // A binary trace would only show up as rejected rows, so its header is caught here.
+            size_t carried = 0;
+            while (carried < sizeof(BINARY_TRACE_MAGIC)) {
+                size_t got = readSome(block.data() + carried, sizeof(BINARY_TRACE_MAGIC) - carried);
+                if (got == 0) break;
+                carried += got;
+            }
+            loadStats.bytesRead += carried;
+            if (carried == sizeof(BINARY_TRACE_MAGIC) && memcmp(block.data(), BINARY_TRACE_MAGIC, carried) == 0) {
+                throw runtime_error("Binary traces cannot be streamed; replay them directly.");
+            }
+            auto push = [&](const Passenger& p) {
+                for (int idle = 0; !ring.tryPush(p); idle++) {
+                    if (stopRequested.load(memory_order_relaxed)) throw StopReading();
+                    backOff(idle);
+                }
+            };
+
+            while (!stopRequested.load(memory_order_relaxed)) {
+                if (carried == block.size()) block.resize(block.size() * 2); // A line longer than a block.
+                size_t got = readSome(block.data() + carried, block.size() - carried);
+                loadStats.bytesRead += got;
+                size_t filled = carried + got;
+                if (got == 0) {
+                    parseRows(block.data(), block.data() + filled, loadStats, push); // Last line, no newline.
+                    break;
+                }
+                const char* start = block.data();
+                const char* lastNewline = nullptr;
+                for (const char* p = start + filled; p > start; p--) {
+                    if (p[-1] == '\n') {
+                        lastNewline = p - 1;
+                        break;
+                    }
+                }
+                if (lastNewline == nullptr) {
+                    carried = filled;
+                    continue;
+                }
+                parseRows(start, lastNewline + 1, loadStats, push);
+                carried = start + filled - (lastNewline + 1);
+                memmove(block.data(), lastNewline + 1, carried);
+            }
+            loadStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+        } catch (const StopReading&) {
+        } catch (...) {
+            readerError = current_exception();
+        }
+        finished.store(true, memory_order_release);
+    }
+
+    struct StopReading {};
+
+    // Reads what is available, up to size bytes; 0 means the input has ended.
+    // Throws StopReading once a stop is requested, even while the input is idle.
+    size_t readSome(char* buffer, size_t size) {
+#ifdef _WIN32
+        if (stopRequested.load(memory_order_relaxed)) throw StopReading();
+        size_t got = fread(buffer, 1, size, input);
+        if (got == 0 && ferror(input)) throw runtime_error("Failed while reading the trace stream.");
+        return got;
+#else
+        int fd = fileno(input);
+        while (true) {
+            if (stopRequested.load(memory_order_relaxed)) throw StopReading();
+            pollfd waitFor = {fd, POLLIN, 0};
+            int ready = poll(&waitFor, 1, 100);
+            if (ready == 0 || (ready < 0 && errno == EINTR)) continue;
+            if (ready < 0) throw runtime_error("Failed while reading the trace stream.");
+            ssize_t got = read(fd, buffer, size);
+            if (got >= 0) return static_cast<size_t>(got);
+            if (errno != EINTR && errno != EAGAIN) throw runtime_error("Failed while reading the trace stream.");
+        }
+#endif
+    }
+
+    SpscRing<Passenger> ring;
+    Passenger* current = nullptr;
+    FILE* input = nullptr;
+    bool ownsInput = false;
+    thread reader;
+    atomic<bool> stopRequested{false};
+    atomic<bool> finished{false};
+    exception_ptr readerError;
+    TraceLoadStats loadStats;
+};
+
+// Binary columnar trace format (version 2). All integers are little-endian.
+//
+//   offset  size  field
+//   0       8     magic "TAXITRC\0"
+//   8       4     format version
+//   12      4     bytes per boarding time (1, 2 or 4)
+//   16      8     passenger count
+//   24      8     size in bytes of the arrival column
+//   32      n     route column:    one routeType byte per passenger
+//           n*w   boarding column: one unsigned boardingTime per passenger
+//           ...   arrival column:  zigzag LEB128 varint deltas, the first one from 0
+//
+// The fixed-size columns come first so their offsets are known from the
+// passenger count alone, which lets the generator write all three columns as
+// it goes.
+// Sorted traces have small non-negative deltas, so a passenger usually costs
+// three bytes on disk instead of a dozen characters of CSV.
+const char BINARY_TRACE_MAGIC[8] = {'T', 'A', 'X', 'I', 'T', 'R', 'C', '\0'};
+const uint32_t BINARY_TRACE_VERSION = 2;
+const size_t BINARY_TRACE_HEADER_SIZE = 32;
+
+uint64_t readLittleEndian(const unsigned char* bytes, int width) {
+    uint64_t value = 0;
+    for (int i = width - 1; i >= 0; i--) value = (value << 8) | bytes[i];
+    return value;
+}
+
+void appendLittleEndian(string& out, uint64_t value, int width) {
+    for (int i = 0; i < width; i++) out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+// Appends one arrival-time delta as a zigzag LEB128 varint.
+void appendArrivalDelta(string& out, long long delta) {
+    uint64_t zigzag = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+    while (zigzag >= 0x80) {
+        out.push_back(static_cast<char>((zigzag & 0x7F) | 0x80));
+        zigzag >>= 7;
+    }
+    out.push_back(static_cast<char>(zigzag));
+}
+
+string binaryTraceHeader(int boardingWidth, uint64_t passengerCount, uint64_t arrivalBytes) {
+    string header(BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC));
+    appendLittleEndian(header, BINARY_TRACE_VERSION, 4);
+    appendLittleEndian(header, boardingWidth, 4);
+    appendLittleEndian(header, passengerCount, 8);
+    appendLittleEndian(header, arrivalBytes, 8);
+    return header;
+}
+
+bool isBinaryTrace(const MappedFile& file) {
+    return file.size() >= sizeof(BINARY_TRACE_MAGIC) &&
+           memcmp(file.data(), BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC)) == 0;
+}
+
+// Writes the passenger list in the binary columnar format.
+void writeBinaryTrace(const string& filename, const vector<Passenger>& passengerList) {
+    int boardingWidth = 1;
+    for (const Passenger& p : passengerList) {
+        if (p.boardingTime < 0) {
+            throw runtime_error("Negative boarding time cannot be stored in a binary trace.");
+        }
+        if (p.boardingTime > 0xFFFF) boardingWidth = 4;
+        else if (p.boardingTime > 0xFF && boardingWidth < 2) boardingWidth = 2;
+    }
+
+    string arrivalColumn;
+    arrivalColumn.reserve(passengerList.size() * 2);
+    long long previousArrival = 0;
+    for (const Passenger& p : passengerList) {
+        appendArrivalDelta(arrivalColumn, p.arrivalTime - previousArrival);
+        previousArrival = p.arrivalTime;
+    }
+
+    string header = binaryTraceHeader(boardingWidth, passengerList.size(), arrivalColumn.size());
+
+    string routeColumn(passengerList.size(), '\0');
+    string boardingColumn;
+    boardingColumn.reserve(passengerList.size() * boardingWidth);
+    for (size_t i = 0; i < passengerList.size(); i++) {
+        routeColumn[i] = passengerList[i].routeType;
+        appendLittleEndian(boardingColumn, static_cast<uint32_t>(passengerList[i].boardingTime), boardingWidth);
+    }
+
+    ofstream file(filename, ios::binary | ios::trunc);
+    if (!file.is_open()) {
+        throw runtime_error("Unable to open output file. " + filename);
+    }
+    file.write(header.data(), header.size());
+    file.write(routeColumn.data(), routeColumn.size());
+    file.write(boardingColumn.data(), boardingColumn.size());
+    file.write(arrivalColumn.data(), arrivalColumn.size());
+    if (!file) {
+        throw runtime_error("Failed while writing output file. " + filename);
+    }
+}
+
+// Arrival source that decodes a mapped binary trace on the fly. It keeps only the
+// passenger it is looking at, so replaying a trace allocates nothing per record.
+class BinaryArrivalSource {
+public:
+    explicit BinaryArrivalSource(const MappedFile& file) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(file.data());
+        if (!isBinaryTrace(file) || file.size() < BINARY_TRACE_HEADER_SIZE) {
+            throw runtime_error("Not a binary passenger trace.");
+        }
+        uint64_t version = readLittleEndian(bytes + 8, 4);
+        if (version != BINARY_TRACE_VERSION) {
+            throw runtime_error("Unsupported binary trace version " + to_string(version) + ".");
+        }
+        boardingWidth = static_cast<int>(readLittleEndian(bytes + 12, 4));
+        passengerCount = readLittleEndian(bytes + 16, 8);
+        uint64_t arrivalBytes = readLittleEndian(bytes + 24, 8);
+
+        uint64_t payload = file.size() - BINARY_TRACE_HEADER_SIZE;
+        bool validWidth = boardingWidth == 1 || boardingWidth == 2 || boardingWidth == 4;
+        if (!validWidth || arrivalBytes > payload ||
+            passengerCount > (payload - arrivalBytes) / (1 + boardingWidth) ||
+            (payload - arrivalBytes) != passengerCount * (1 + boardingWidth)) {
+            throw runtime_error("Binary trace is truncated or corrupt.");
+        }
+
+        routeColumn = bytes + BINARY_TRACE_HEADER_SIZE;
+        boardingColumn = routeColumn + passengerCount;
+        arrivalCursor = boardingColumn + passengerCount * boardingWidth;
+        arrivalEnd = arrivalCursor + arrivalBytes;
+        decodeCurrent();
+    }
+
+    bool done() const { return index >= passengerCount; }
+    const Passenger& peek() const { return current; }
+    void advance() {
+        index++;
+        decodeCurrent();
+    }
+
+    uint64_t size() const { return passengerCount; }
+
+private:
+    void decodeCurrent() {
+        if (done()) return;
+        uint64_t zigzag = 0;
+        int shift = 0;
+        while (arrivalCursor < arrivalEnd && shift < 64) {
+            unsigned char byte = *arrivalCursor++;
+            zigzag |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) break;
+            shift += 7;
+        }
+        long long delta = static_cast<long long>(zigzag >> 1) ^ -static_cast<long long>(zigzag & 1);
+        previousArrival += delta;
+
+        current.arrivalTime = static_cast<int>(previousArrival);
+        current.routeType = static_cast<char>(routeColumn[index]);
+        current.boardingTime = static_cast<int>(readLittleEndian(boardingColumn + index * boardingWidth, boardingWidth));
+    }
+
+    const unsigned char* arrivalCursor = nullptr;
+    const unsigned char* arrivalEnd = nullptr;
+    const unsigned char* routeColumn = nullptr;
+    const unsigned char* boardingColumn = nullptr;
+    int boardingWidth = 1;
+    uint64_t passengerCount = 0;
+    uint64_t index = 0;
+    long long previousArrival = 0;
+    Passenger current = {'?', 0, 0, 0};
+};
+
+// Converts a CSV trace into the binary columnar format.
+void convertTrace(const string& csvFilename, const string& binaryFilename) {
+    TraceLoadStats loadStats;
+    vector<Passenger> passengerList = readFileData(csvFilename, loadStats);
+    printLoadSummary(csvFilename, loadStats);
+    writeBinaryTrace(binaryFilename, passengerList);
+
+    ifstream written(binaryFilename, ios::binary | ios::ate);
+    double ratio = written.tellg() > 0 ? static_cast<double>(loadStats.bytesRead) / written.tellg() : 0.0;
+    cout << "Wrote " << passengerList.size() << " passengers to " << binaryFilename
+         << " (" << written.tellg() << " bytes, " << fixed << setprecision(1) << ratio
+         << "x smaller than the CSV)" << defaultfloat << endl;
+}
+
+// Arrival source over one trace file, CSV or binary. CSV rows are parsed one
+// at a time straight from the mapping, so only the pages being read are
+// resident however long the file is.
+class TraceFileSource {
+public:
+    explicit TraceFileSource(const string& filename) : file(filename) {
+        if (isBinaryTrace(file)) {
+            binary.reset(new BinaryArrivalSource(file));
+        } else {
+            cursor = file.data();
+            fileEnd = cursor + file.size();
+            loadStats.bytesRead = file.size();
+            advance();
+        }
+    }
+
+    bool done() const { return binary ? binary->done() : !hasCurrent; }
+    const Passenger& peek() const { return binary ? binary->peek() : current; }
+    void advance() {
+        if (binary) binary->advance();
+        else hasCurrent = parseNextRow(cursor, fileEnd, loadStats, current);
+    }
+
+    bool isBinary() const { return binary != nullptr; }
+    const TraceLoadStats& stats() const { return loadStats; }
+
+private:
+    MappedFile file;
+    unique_ptr<BinaryArrivalSource> binary;
+    const char* cursor = nullptr;
+    const char* fileEnd = nullptr;
+    bool hasCurrent = false;
+    Passenger current = {'?', 0, 0, 0};
+    TraceLoadStats loadStats;
+};
+
+// Arrival source over a sorted run spilled by the external sort: raw
+// Passenger records, read through a fixed buffer. The file is deleted when
+// the source is destroyed.
+class RunFileSource {
+public:
+    RunFileSource(const string& filename, size_t bufferPassengers)
+        : path(filename), buffer(max<size_t>(bufferPassengers, 1)) {
+        input = fopen(path.c_str(), "rb");
+        if (input == nullptr) throw runtime_error("Unable to open sort run. " + path);
+        refill();
+    }
+
+    ~RunFileSource() {
+        fclose(input);
+        remove(path.c_str());
+    }
+
+    RunFileSource(const RunFileSource&) = delete;
+    RunFileSource& operator=(const RunFileSource&) = delete;
+
+    bool done() const { return position >= filled; }
+    const Passenger& peek() const { return buffer[position]; }
+    void advance() {
+        if (++position == filled) refill();
+    }
+
+private:
+    void refill() {
+        filled = fread(buffer.data(), sizeof(Passenger), buffer.size(), input);
+        position = 0;
+    }
+
+    string path;
+    FILE* input = nullptr;
+    vector<Passenger> buffer;
+    size_t filled = 0;
+    size_t position = 0;
+};
+
+// k-way merge of arrival sources that are each in arrival order, through a
+// min-heap keyed on (arrival time, source index). Ties go to the earlier
+// source, so the merged stream is exactly a stable sort of the sources laid
+// end to end.
+template <typename Source>
+class MergeArrivalSource {
+public:
+    explicit MergeArrivalSource(vector<unique_ptr<Source>> inputs) : sources(move(inputs)) {
+        for (size_t i = 0; i < sources.size(); i++) {
+            if (!sources[i]->done()) heads.push({sources[i]->peek().arrivalTime, i});
+        }
+    }
+
+    bool done() const { return heads.empty(); }
+    const Passenger& peek() const { return sources[heads.top().second]->peek(); }
+    void advance() {
+        size_t i = heads.top().second;
+        heads.pop();
+        Source& source = *sources[i];
+        int previousArrival = source.peek().arrivalTime;
+        source.advance();
+        if (source.done()) return;
+        if (source.peek().arrivalTime < previousArrival) {
+            throw runtime_error("Merged trace " + to_string(i + 1) + " is not in arrival order; use --sort.");
+        }
+        heads.push({source.peek().arrivalTime, i});
+    }
+
+    Source& source(size_t i) { return *sources[i]; }
+    size_t size() const { return sources.size(); }
+
+private:
+    using Head = pair<int, size_t>;
+    vector<unique_ptr<Source>> sources;
+    priority_queue<Head, vector<Head>, greater<Head>> heads;
+};
+
+// Settings for putting traces into one arrival-ordered stream.
+struct MergeOptions {
+    bool sort = false;                   // Inputs may be out of order: sort them.
+    size_t memoryBytes = 256u << 20;     // Sort buffer; runs beyond it spill to disk.
+    string runPrefix;                    // Spilled runs go to <prefix>.<n>.run.
+};
+
+// Appends a sorted run to disk and returns its name.
+string spillSortRun(vector<Passenger>& run, const string& prefix, size_t runNumber) {
+    stable_sort(run.begin(), run.end(),
+                [](const Passenger& a, const Passenger& b) { return a.arrivalTime < b.arrivalTime; });
+    string filename = prefix + "." + to_string(runNumber) + ".run";
+    FILE* output = fopen(filename.c_str(), "wb");
+    if (output == nullptr) throw runtime_error("Unable to create sort run. " + filename);
+    size_t written = fwrite(run.data(), sizeof(Passenger), run.size(), output);
+    if (fclose(output) != 0 || written != run.size()) {
+        remove(filename.c_str());
+        throw runtime_error("Failed while writing sort run. " + filename);
+    }
+    run.clear();
+    return filename;
+}
+
+void printMergeSummary(size_t files, uint64_t passengers, const TraceLoadStats& loadStats, const string& how,
+                       double seconds) {
+    cerr << "Ordered " << passengers << " passengers from " << files << " trace file" << (files == 1 ? "" : "s")
+         << " (" << how << ", " << loadStats.rowsRejected << " rejected rows, " << fixed << setprecision(2)
+         << seconds * 1e3 << " ms)" << defaultfloat << endl;
+}
+
+// Puts the trace files into one stream in arrival order and calls
+// run(arrivals) with it. Without merge.sort the files must each be sorted
+// already and are k-way merged as they are read, in constant memory. With it
+// they are read in order into a buffer of merge.memoryBytes; each time it
+// fills it is sorted and spilled to disk as a run, and the runs are k-way
+// merged. Input that fits in the buffer is never written out. Either way
+// passengers with equal arrival times keep their order in the file list.
+template <typename Run>
+SimulationSummary withOrderedTraces(const vector<string>& filenames, const MergeOptions& merge, Run run) {
+    auto start = chrono::steady_clock::now();
+    auto elapsed = [&]() { return chrono::duration<double>(chrono::steady_clock::now() - start).count(); };
+    TraceLoadStats loadStats;
+
+    if (!merge.sort) {
+        vector<unique_ptr<TraceFileSource>> inputs;
+        for (const string& filename : filenames) inputs.emplace_back(new TraceFileSource(filename));
+        MergeArrivalSource<TraceFileSource> arrivals(move(inputs));
+        SimulationSummary summary = run(arrivals);
+        uint64_t passengers = 0;
+        for (size_t i = 0; i < arrivals.size(); i++) {
+            const TraceLoadStats& stats = arrivals.source(i).stats();
+            loadStats.rowsRejected += stats.rowsRejected;
+            passengers += stats.rowsAccepted;
+        }
+        printMergeSummary(filenames.size(), passengers, loadStats, "k-way merge", elapsed());
+        return summary;
+    }
+
+    size_t bufferPassengers = max<size_t>(merge.memoryBytes / sizeof(Passenger), 1024);
+    vector<Passenger> buffer;
+    buffer.reserve(bufferPassengers);
+    vector<string> runNames;
+    uint64_t passengers = 0;
+    try {
+        for (const string& filename : filenames) {
+            TraceFileSource input(filename);
+            for (; !input.done(); input.advance()) {
+                if (buffer.size() == bufferPassengers) {
+                    runNames.push_back(spillSortRun(buffer, merge.runPrefix, runNames.size()));
+                }
+                buffer.push_back(input.peek());
+                passengers++;
+            }
+            loadStats.rowsRejected += input.stats().rowsRejected;
+        }
+        if (!runNames.empty() && !buffer.empty()) {
+            runNames.push_back(spillSortRun(buffer, merge.runPrefix, runNames.size()));
+        }
+    } catch (...) {
+        for (const string& name : runNames) remove(name.c_str());
+        throw;
+    }
+
+    if (runNames.empty()) {
+        stable_sort(buffer.begin(), buffer.end(),
+                    [](const Passenger& a, const Passenger& b) { return a.arrivalTime < b.arrivalTime; });
+        printMergeSummary(filenames.size(), passengers, loadStats, "sorted in memory", elapsed());
+        VectorArrivalSource arrivals(buffer);
+        return run(arrivals);
+    }
+
+    // The merge reads every run at once, so the buffer is shared out between them.
+    vector<Passenger>().swap(buffer);
+    size_t runBuffer = max<size_t>(bufferPassengers / runNames.size(), 1024);
+    vector<unique_ptr<RunFileSource>> runs;
+    try {
+        for (const string& name : runNames) runs.emplace_back(new RunFileSource(name, runBuffer));
+    } catch (...) {
+        for (size_t i = runs.size(); i < runNames.size(); i++) remove(runNames[i].c_str());
+        throw;
+    }
+    printMergeSummary(filenames.size(), passengers, loadStats,
+                      "external sort, " + to_string(runNames.size()) + " runs", elapsed());
+    MergeArrivalSource<RunFileSource> arrivals(move(runs));
+    return run(arrivals);
+}
+
+// SplitMix64 random number generator. It is tiny, fast and gives the same
+// sequence on every platform, which keeps replications reproducible.
+struct SplitMix64 {
+    uint64_t state;
+
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform double in [0, 1).
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    // Uniform integer in [0, bound).
+    uint64_t below(uint64_t bound) { return next() % bound; }
+};
+
+// Seed of one replication. It depends only on the base seed and the replication
+// number, never on which thread runs it.
+uint64_t replicationSeed(uint64_t baseSeed, uint64_t replication) {
+    SplitMix64 mixer(baseSeed ^ (replication * 0xD1B54A32D192ED03ULL));
+    return mixer.next();
+}
+
+// Per-route arrival rate and boarding times observed in a trace. Randomized
+// days are drawn from it: Poisson arrivals at the observed rate over the
+// observed time window, with boarding times resampled from the observed ones.
+struct TraceModel {
+    vector<double> arrivalRate;            // Passengers per time unit.
+    vector<int> firstArrival;
+    vector<int> lastArrival;
+    vector<vector<int>> boardingTimes;
+};
+
+TraceModel fitTraceModel(const vector<Passenger>& passengerList, const RouteTable& table) {
+    TraceModel model;
+    int routes = table.routeCount();
+    model.arrivalRate.assign(routes, 0.0);
+    model.firstArrival.assign(routes, INT_MAX);
+    model.lastArrival.assign(routes, INT_MIN);
+    model.boardingTimes.resize(routes);
+
+    for (const Passenger& p : passengerList) {
+        int route = table.routeIndex(p.routeType);
+        if (route < 0) continue;
+        model.firstArrival[route] = min(model.firstArrival[route], p.arrivalTime);
+        model.lastArrival[route] = max(model.lastArrival[route], p.arrivalTime);
+        model.boardingTimes[route].push_back(p.boardingTime);
+    }
+    for (int r = 0; r < routes; r++) {
+        if (model.boardingTimes[r].empty()) continue;
+        double window = model.lastArrival[r] - model.firstArrival[r] + 1.0;
+        model.arrivalRate[r] = model.boardingTimes[r].size() / window;
+    }
+    return model;
+}
+
+// Draws one randomized day from the model, sorted by arrival time.
+vector<Passenger> sampleDay(const TraceModel& model, const RouteTable& table, uint64_t seed) {
+    SplitMix64 rng(seed);
+    vector<Passenger> day;
+    for (int r = 0; r < table.routeCount(); r++) {
+        if (model.boardingTimes[r].empty()) continue;
+        const vector<int>& boarding = model.boardingTimes[r];
+        double clock = model.firstArrival[r];
+        while (true) {
+            clock += -log(1.0 - rng.uniform()) / model.arrivalRate[r];
+            if (clock >= model.lastArrival[r] + 1.0) break;
+            int boardingTime = boarding[rng.below(boarding.size())];
+            day.push_back({table.labels[r], 0, boardingTime, static_cast<int>(clock)});
+        }
+    }
+    stable_sort(day.begin(), day.end(),
+                [](const Passenger& a, const Passenger& b) { return a.arrivalTime < b.arrivalTime; });
+    return day;
+}
+
+// Runs task(index) for every index in [0, count) on the given number of threads.
+// Each worker starts with its own contiguous block of indices and takes work from
+// the front of it. A worker whose block is empty steals the back half of another
+// worker's block, so uneven tasks still keep every core busy. A block is one
+// 64-bit atomic holding (begin << 32 | end), so both ends change with one CAS.
+template <typename Task>
+void parallelFor(size_t count, int threadCount, Task task) {
+    if (count == 0) return;
+    if (count > 0xFFFFFFFFULL) throw runtime_error("Too many parallel tasks.");
+    threadCount = max(1, min<int>(threadCount, static_cast<int>(count)));
+
+    auto pack = [](uint64_t begin, uint64_t end) { return (begin << 32) | end; };
+    vector<atomic<uint64_t>> blocks(threadCount);
+    for (int w = 0; w < threadCount; w++) {
+        blocks[w].store(pack(count * w / threadCount, count * (w + 1) / threadCount));
+    }
+
+    auto worker = [&](int self) {
+        while (true) {
+            // Take the next index from the front of our own block.
+            uint64_t range = blocks[self].load();
+            uint64_t begin = range >> 32, end = range & 0xFFFFFFFFULL;
+            if (begin < end) {
+                if (blocks[self].compare_exchange_weak(range, pack(begin + 1, end))) task(begin);
+                continue;
+            }
+
+            // Our block is empty: steal the back half of someone else's.
+            bool stole = false;
+            for (int offset = 1; offset < threadCount && !stole; offset++) {
+                int victim = (self + offset) % threadCount;
+                uint64_t victimRange = blocks[victim].load();
+                uint64_t victimBegin = victimRange >> 32, victimEnd = victimRange & 0xFFFFFFFFULL;
+                while (victimBegin < victimEnd) {
+                    uint64_t split = victimEnd - max<uint64_t>(1, (victimEnd - victimBegin) / 2);
+                    if (blocks[victim].compare_exchange_weak(victimRange, pack(victimBegin, split))) {
+                        blocks[self].store(pack(split, victimEnd));
+                        stole = true;
+                        break;
+                    }
+                    victimBegin = victimRange >> 32;
+                    victimEnd = victimRange & 0xFFFFFFFFULL;
+                }
+            }
+            if (!stole) return; // Nothing left anywhere.
+        }
+    };
+
+    vector<thread> threads;
+    for (int w = 1; w < threadCount; w++) threads.emplace_back(worker, w);
+    worker(0);
+    for (thread& t : threads) t.join();
+}
+
+int defaultThreadCount() {
+    unsigned cores = thread::hardware_concurrency();
+    return cores > 0 ? static_cast<int>(cores) : 1;
+}
+
+// Two-sided 95% Student t critical value for the given degrees of freedom.
+double tCritical95(long long degreesOfFreedom) {
+    static const double table[] = {0.0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+                                   2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+                                   2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (degreesOfFreedom < 1) return 0.0;
+    if (degreesOfFreedom <= 30) return table[degreesOfFreedom];
+    if (degreesOfFreedom <= 60) return 2.000;
+    if (degreesOfFreedom <= 120) return 1.980;
+    return 1.960;
+}
+
+// Mean and 95% confidence interval of one metric across replications.
+struct MetricInterval {
+    double mean = 0.0;
+    double standardDeviation = 0.0;
+    double halfWidth = 0.0;
+};
+
+MetricInterval confidenceInterval(const vector<double>& samples) {
+    MetricInterval interval;
+    size_t n = samples.size();
+    if (n == 0) return interval;
+    for (double x : samples) interval.mean += x;
+    interval.mean /= n;
+    if (n > 1) {
+        double squares = 0.0;
+        for (double x : samples) squares += (x - interval.mean) * (x - interval.mean);
+        interval.standardDeviation = sqrt(squares / (n - 1));
+        interval.halfWidth = tCritical95(n - 1) * interval.standardDeviation / sqrt(static_cast<double>(n));
+    }
+    return interval;
+}
+
+// Runs randomized replications of the day described by the trace and prints
+// confidence intervals of the main metrics. Each replication writes only its
+// own slot and the slots are merged in replication order, so the results are
+// identical for a given seed whatever the thread count.
+void runReplications(const vector<Passenger>& passengerList, const RouteTable& table,
+                     int replications, uint64_t seed, int threadCount, ostream& out) {
+    TraceModel model = fitTraceModel(passengerList, table);
+
+    // Only the merged metrics are kept per replication; the histograms are dropped.
+    struct ReplicationResult {
+        double meanWait, meanQueueLength, peakQueueLength, throughput, passengersBoarded;
+    };
+    vector<ReplicationResult> results(replications);
+
+    auto runStart = chrono::steady_clock::now();
+    parallelFor(replications, threadCount, [&](size_t replication) {
+        vector<Passenger> day = sampleDay(model, table, replicationSeed(seed, replication));
+        VectorArrivalSource arrivals(day);
+        NullWriter writer;
+        SimulationSummary summary = runSimulation(arrivals, table, writer);
+        results[replication] = {summary.meanWait(), summary.meanQueueLength(),
+                                static_cast<double>(summary.peakQueueLength), summary.throughput(),
+                                static_cast<double>(summary.passengersBoarded)};
+    });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - runStart).count();
+
+    vector<double> meanWait, meanQueue, peakQueue, throughput, boarded;
+    for (const ReplicationResult& r : results) {
+        meanWait.push_back(r.meanWait);
+        meanQueue.push_back(r.meanQueueLength);
+        peakQueue.push_back(r.peakQueueLength);
+        throughput.push_back(r.throughput);
+        boarded.push_back(r.passengersBoarded);
+    }
+
+    out << "Monte Carlo replications: " << replications << " (seed " << seed << ", "
+        << max(1, min(threadCount, replications)) << " threads, " << fixed << setprecision(2)
+        << seconds << " s)\n\n";
+    out << left << setw(24) << "Metric" << right << setw(14) << "Mean" << setw(14) << "Std dev"
+        << setw(26) << "95% confidence interval" << "\n";
+
+    auto printMetric = [&](const string& name, const vector<double>& samples) {
+        MetricInterval ci = confidenceInterval(samples);
+        out << left << setw(24) << name << right << fixed << setprecision(4)
+            << setw(14) << ci.mean << setw(14) << ci.standardDeviation
+            << setw(12) << ci.mean - ci.halfWidth << " .. " << setw(10) << ci.mean + ci.halfWidth << "\n";
+    };
+    printMetric("Mean wait", meanWait);
+    printMetric("Mean queue length", meanQueue);
+    printMetric("Peak queue length", peakQueue);
+    printMetric("Throughput (pax/unit)", throughput);
+    printMetric("Passengers boarded", boarded);
+    out << defaultfloat << flush;
+}
+
+// One axis of a parameter sweep: first, last and step, written "first:last[:step]"
+// on the command line. A single number is a sweep of one value.
+struct SweepRange {
+    double first = 0.0;
+    double last = 0.0;
+    double step = 1.0;
+
+    vector<double> values() const {
+        vector<double> result;
+        // The small tolerance keeps 0.5:2:0.25 from losing its last value to rounding.
+        for (int i = 0; first + i * step <= last + step * 1e-9; i++) result.push_back(first + i * step);
+        return result;
+    }
+};
+
+bool parseSweepRange(const string& text, SweepRange& range) {
+    char* end = nullptr;
+    range.first = strtod(text.c_str(), &end);
+    range.last = range.first;
+    range.step = 1.0;
+    if (end == text.c_str()) return false;
+    if (*end == ':') {
+        const char* lastStart = end + 1;
+        range.last = strtod(lastStart, &end);
+        if (end == lastStart) return false;
+        if (*end == ':') {
+            const char* stepStart = end + 1;
+            range.step = strtod(stepStart, &end);
+            if (end == stepStart) return false;
+        }
+    }
+    return *end == '\0' && range.step > 0.0 && range.last >= range.first;
+}
+
+struct SweepConfiguration {
+    int capacity;
+    int taxisPerRoute;
+    double boardingScale;
+};
+
+// The few numbers kept per configuration, so a large grid stays small in memory.
+struct SweepResult {
+    double throughput = 0.0;
+    int p50Wait = 0;
+    int p95Wait = 0;
+    int p99Wait = 0;
+    size_t peakQueueLength = 0;
+};
+
+// Copy of the route table with the same routes but a different fleet.
+RouteTable withFleet(const RouteTable& base, int taxisPerRoute, int capacity) {
+    RouteTable table;
+    for (int r = 0; r < base.routeCount(); r++) table.addRoute(base.labels[r], taxisPerRoute, capacity);
+    return table;
+}
+
+// Simulates every combination of capacity, taxis per route and boarding-time
+// multiplier. The trace is loaded once and shared read-only by all workers;
+// each configuration gets its own route table and rank state.
+void runSweep(const vector<Passenger>& passengerList, const RouteTable& baseTable,
+              const SweepRange& capacities, const SweepRange& fleetSizes, const SweepRange& boardingScales,
+              int threadCount, ostream& out) {
+    vector<SweepConfiguration> grid;
+    for (double capacity : capacities.values()) {
+        for (double taxis : fleetSizes.values()) {
+            for (double scale : boardingScales.values()) {
+                if (lround(capacity) < 1 || lround(taxis) < 1) {
+                    throw runtime_error("Sweep needs at least one taxi and one seat per taxi.");
+                }
+                grid.push_back({static_cast<int>(lround(capacity)), static_cast<int>(lround(taxis)), scale});
+            }
+        }
+    }
+
+    vector<SweepResult> results(grid.size());
+    auto runStart = chrono::steady_clock::now();
+    parallelFor(grid.size(), threadCount, [&](size_t index) {
+        const SweepConfiguration& config = grid[index];
+        RouteTable table = withFleet(baseTable, config.taxisPerRoute, config.capacity);
+        VectorArrivalSource trace(passengerList);
+        ScaledArrivalSource<VectorArrivalSource> arrivals(trace, config.boardingScale);
+        NullWriter writer;
+        SimulationSummary summary = runSimulation(arrivals, table, writer);
+        results[index] = {summary.throughput(), summary.percentileWait(0.50), summary.percentileWait(0.95),
+                          summary.percentileWait(0.99), summary.peakQueueLength};
+    });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - runStart).count();
+
+    out << "Parameter sweep: " << grid.size() << " configurations over " << passengerList.size()
+        << " passengers (" << fixed << setprecision(2) << seconds << " s)\n\n";
+    out << right << setw(9) << "Capacity" << setw(7) << "Taxis" << setw(10) << "Boarding"
+        << setw(12) << "Throughput" << setw(8) << "p50" << setw(8) << "p95" << setw(8) << "p99"
+        << setw(8) << "PeakQ" << "\n";
+    for (size_t i = 0; i < grid.size(); i++) {
+        const SweepResult& r = results[i];
+        out << setw(9) << grid[i].capacity << setw(7) << grid[i].taxisPerRoute
+            << setw(9) << setprecision(2) << grid[i].boardingScale << "x"
+            << setw(12) << setprecision(4) << r.throughput
+            << setw(8) << r.p50Wait << setw(8) << r.p95Wait << setw(8) << r.p99Wait
+            << setw(8) << r.peakQueueLength << "\n";
+    }
+    out << defaultfloat << flush;
+}
+
+// Analytic estimate of each route's queue, for quick capacity questions that do
+// not need a full run. Passengers board one at a time, so a route with c taxis
+// is a c-server queue. A passenger's service time is their boarding time (at
+// least one unit), and every K-th passenger of a taxi with K seats also costs
+// the one unit in which the full taxi is replaced. Passengers who arrive at the
+// same time form a group, so arrivals are modelled as groups (M^X/G/c):
+//   - the wait for a free taxi is Allen-Cunneen's approximation, the M/M/c
+//     (Erlang C) wait scaled by (Ca^2 + Cs^2) / 2, where Ca^2 and Cs^2 are the
+//     squared coefficients of variation of the gaps between groups and of the
+//     service times, both fitted to the trace;
+//   - on top of that each passenger waits for the ones ahead of them in their
+//     own group, (E[X^2] - E[X]) / (2 E[X]) services spread over c taxis,
+//     stretched by 1 / (1 - utilization) as in the M^X/G/1 formula.
+// A route that cannot keep up has no steady state; its queue grows linearly,
+// and the estimate is the mean over the trace window.
+struct RouteLoad {
+    long long passengers = 0;
+    long long groups = 0;              // Distinct arrival times.
+    int firstArrival = 0;
+    int lastArrival = 0;
+    double arrivalRate = 0.0;          // Passengers per time unit.
+    double arrivalScv = 1.0;           // Squared coefficient of variation of the gaps between groups.
+    double groupMean = 1.0;            // Passengers per group.
+    double groupSecondMoment = 1.0;
+    double serviceMean = 0.0;          // Boarding time per passenger, at least one unit.
+    double serviceSecondMoment = 0.0;
+};
+
+// One pass over the trace; nothing is kept per passenger.
+vector<RouteLoad> fitRouteLoads(const vector<Passenger>& passengerList, const RouteTable& table) {
+    int routes = table.routeCount();
+    vector<RouteLoad> loads(routes);
+    vector<double> gapSum(routes, 0.0), gapSquareSum(routes, 0.0), groupSquareSum(routes, 0.0);
+    vector<long long> groupSize(routes, 0);
+    for (const Passenger& p : passengerList) {
+        int route = table.routeIndex(p.routeType);
+        if (route < 0) continue;
+        RouteLoad& load = loads[route];
+        if (load.passengers == 0) {
+            load.firstArrival = p.arrivalTime;
+            load.lastArrival = p.arrivalTime;
+        }
+        if (load.passengers == 0 || p.arrivalTime > load.lastArrival) {
+            if (load.passengers > 0) {
+                double gap = p.arrivalTime - load.lastArrival;
+                gapSum[route] += gap;
+                gapSquareSum[route] += gap * gap;
+                groupSquareSum[route] += static_cast<double>(groupSize[route]) * groupSize[route];
+            }
+            load.lastArrival = p.arrivalTime;
+            load.groups++;
+            groupSize[route] = 0;
+        }
+        groupSize[route]++;   // Out-of-order rows join the current group.
+        double service = max(1, p.boardingTime);
+        load.serviceMean += service;
+        load.serviceSecondMoment += service * service;
+        load.passengers++;
+    }
+    for (int r = 0; r < routes; r++) {
+        RouteLoad& load = loads[r];
+        if (load.passengers == 0) continue;
+        groupSquareSum[r] += static_cast<double>(groupSize[r]) * groupSize[r];
+        load.arrivalRate = load.passengers / (load.lastArrival - load.firstArrival + 1.0);
+        load.groupMean = static_cast<double>(load.passengers) / load.groups;
+        load.groupSecondMoment = groupSquareSum[r] / load.groups;
+        load.serviceMean /= load.passengers;
+        load.serviceSecondMoment /= load.passengers;
+        if (load.groups > 2) {
+            double gaps = load.groups - 1.0;
+            double mean = gapSum[r] / gaps;
+            load.arrivalScv = max(0.0, gapSquareSum[r] / gaps - mean * mean) / (mean * mean);
+        }
+    }
+    return loads;
+}
+
+struct QueueEstimate {
+    double utilization = 0.0;          // Offered load per taxi; 1 or more is overloaded.
+    double meanWait = 0.0;
+    double meanQueueLength = 0.0;
+    bool overloaded = false;
+};
+
+QueueEstimate estimateRouteQueue(const RouteLoad& load, int taxis, int seats) {
+    QueueEstimate estimate;
+    if (load.arrivalRate <= 0.0) return estimate;
+
+    // The changeover unit is charged to one passenger in K.
+    double changeover = 1.0 / seats;
+    double service = load.serviceMean + changeover;
+    double serviceSecond = load.serviceSecondMoment + (2.0 * load.serviceMean + 1.0) * changeover;
+    double serviceScv = max(0.0, serviceSecond - service * service) / (service * service);
+
+    double offered = load.arrivalRate * service;   // Erlangs.
+    estimate.utilization = offered / taxis;
+    if (estimate.utilization >= 1.0) {
+        double window = load.lastArrival - load.firstArrival + 1.0;
+        estimate.overloaded = true;
+        estimate.meanWait = (estimate.utilization - 1.0) * window / 2.0;
+        estimate.meanQueueLength = (load.arrivalRate - taxis / service) * window / 2.0;
+        return estimate;
+    }
+
+    double erlangB = 1.0;
+    for (int k = 1; k <= taxis; k++) erlangB = offered * erlangB / (k + offered * erlangB);
+    double erlangC = erlangB / (1.0 - estimate.utilization * (1.0 - erlangB));
+    double exponentialWait = erlangC * service / (taxis - offered);
+    double groupWait = (load.groupSecondMoment - load.groupMean) / (2.0 * load.groupMean) * service / taxis;
+    estimate.meanWait = exponentialWait * (load.arrivalScv + serviceScv) / 2.0
+                      + groupWait / (1.0 - estimate.utilization);
+    estimate.meanQueueLength = load.arrivalRate * estimate.meanWait;
+    return estimate;
+}
+
+// Prints the estimate for every route. rateOverride (passengers per time unit,
+// negative for "as fitted") asks what-if questions about other demand levels.
+// With check set the trace is also simulated and each estimate is compared
+// with the simulated figure, so the model can be trusted or not per route.
+void runEstimate(const vector<Passenger>& passengerList, const RouteTable& table, const vector<double>& rateOverride,
+                 bool check, ostream& out) {
+    auto fitStart = chrono::steady_clock::now();
+    vector<RouteLoad> loads = fitRouteLoads(passengerList, table);
+    auto solveStart = chrono::steady_clock::now();
+    int routes = table.routeCount();
+    vector<QueueEstimate> estimates(routes);
+    for (int r = 0; r < routes; r++) {
+        if (rateOverride[r] >= 0.0) loads[r].arrivalRate = rateOverride[r];
+        estimates[r] = estimateRouteQueue(loads[r], table.taxiCount[r], table.capacity[r]);
+    }
+    auto solveEnd = chrono::steady_clock::now();
+    double fitSeconds = chrono::duration<double>(solveStart - fitStart).count();
+    double solveSeconds = chrono::duration<double>(solveEnd - solveStart).count();
+
+    SimulationSummary simulated;
+    double simulateSeconds = 0.0;
+    if (check) {
+        NullWriter writer;
+        VectorArrivalSource arrivals(passengerList);
+        simulated = runSimulation(arrivals, table, writer);
+        simulateSeconds = chrono::duration<double>(chrono::steady_clock::now() - solveEnd).count();
+    }
+
+    out << "Queueing estimate (M^X/G/c, Allen-Cunneen): fitted in " << fixed << setprecision(2) << fitSeconds * 1e3
+        << " ms, solved in " << solveSeconds * 1e6 << " us";
+    if (check) out << "; simulation took " << simulateSeconds * 1e3 << " ms";
+    out << "\n\n";
+    out << left << setw(7) << "Route" << right << setw(10) << "Rate" << setw(7) << "Taxis" << setw(7) << "Seats"
+        << setw(9) << "Service" << setw(7) << "Ca2" << setw(7) << "Group" << setw(7) << "Util" << setw(11) << "Wait(est)"
+        << setw(10) << "Lq(est)";
+    if (check) out << setw(11) << "Wait(sim)" << setw(9) << "Error";
+    out << "\n";
+
+    double estimatedQueue = 0.0;
+    double worstError = 0.0;
+    for (int r = 0; r < routes; r++) {
+        const RouteLoad& load = loads[r];
+        const QueueEstimate& estimate = estimates[r];
+        estimatedQueue += estimate.meanQueueLength;
+        out << left << setw(7) << table.labels[r] << right << setprecision(4) << setw(10) << load.arrivalRate
+            << setw(7) << table.taxiCount[r] << setw(7) << table.capacity[r] << setprecision(2)
+            << setw(9) << load.serviceMean << setw(7) << load.arrivalScv << setw(7) << load.groupMean
+            << setw(7) << estimate.utilization
+            << setw(11) << estimate.meanWait << setw(10) << estimate.meanQueueLength;
+        if (check) {
+            double simulatedWait = simulated.routeMetrics[r].wait.mean();
+            out << setw(11) << simulatedWait;
+            // Relative error, measured against one time unit for waits shorter than that.
+            double error = (estimate.meanWait - simulatedWait) / max(1.0, simulatedWait);
+            worstError = max(worstError, fabs(error));
+            out << setw(8) << setprecision(1) << error * 100.0 << "%";
+        }
+        if (estimate.overloaded) out << "  overloaded";
+        out << "\n";
+    }
+    out << "\nEstimated mean queue length: " << setprecision(3) << estimatedQueue;
+    if (check) {
+        out << " (simulated " << simulated.meanQueueLength() << ")\nLargest wait error: " << setprecision(1)
+            << worstError * 100.0 << "% of the simulated wait (or of one time unit when shorter)";
+    }
+    out << "\n" << defaultfloat << flush;
+}
+
+// Live metrics. A long run can publish its progress into a named shared-memory
+// segment (--live-metrics <name>) that any number of readers (--watch <name>)
+// map and poll. The layout is fixed, so readers need no protocol. Updates use
+// a seqlock: the simulation bumps sequence to an odd value, writes the
+// fields, then bumps it to even again, and never waits for anyone. A reader
+// copies the fields and keeps the copy only if sequence was the same even
+// value before and after. Every field is a lock-free atomic, so the copy is
+// well defined even when it races with a write.
+static_assert(atomic<int64_t>::is_always_lock_free, "Live metrics need lock-free 64-bit atomics.");
+
+const char LIVE_METRICS_MAGIC[8] = {'T', 'A', 'X', 'I', 'L', 'I', 'V', 'E'};
+const uint32_t LIVE_METRICS_VERSION = 1;
+const int LIVE_METRICS_MAX_ROUTES = 256;   // One per routeType byte.
+
+struct LiveMetricsLayout {
+    char magic[8];
+    uint32_t version;
+    uint32_t routeCount;
+    char labels[LIVE_METRICS_MAX_ROUTES];
+    atomic<uint64_t> sequence;             // Odd while the simulation is writing.
+    atomic<int64_t> finished;              // 1 once the run has ended.
+    atomic<int64_t> wallMillis;            // Wall-clock time since the run started.
+    atomic<int64_t> simTime;
+    atomic<int64_t> passengersArrived;
+    atomic<int64_t> passengersBoarded;
+    atomic<int64_t> waitingPassengers;
+    atomic<int64_t> departures;
+    atomic<int64_t> eventsProcessed;
+    atomic<int64_t> eventsPerSecond;       // Over the last publishing interval.
+    atomic<int64_t> queueDepth[LIVE_METRICS_MAX_ROUTES];
+    atomic<int64_t> routeBoarded[LIVE_METRICS_MAX_ROUTES];
+    atomic<int64_t> routeDepartures[LIVE_METRICS_MAX_ROUTES];
+};
+
+// Maps a named shared-memory segment of the live metrics layout, creating it
+// for the simulation or opening it read-only for a reader.
+class LiveMetricsSegment {
+public:
+    LiveMetricsSegment(const string& segmentName, bool create) {
+        size_t length = sizeof(LiveMetricsLayout);
+#ifdef _WIN32
+        string name = "Local\\" + segmentName;
+        if (create) {
+            mappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                                               static_cast<DWORD>(length), name.c_str());
+        } else {
+            mappingHandle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+        }
+        if (mappingHandle == NULL) throw runtime_error("Unable to open live metrics segment. " + segmentName);
+        void* mapping = MapViewOfFile(mappingHandle, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length);
+        if (mapping == NULL) {
+            CloseHandle(mappingHandle);
+            throw runtime_error("Unable to map live metrics segment. " + segmentName);
+        }
+#else
+        name = segmentName[0] == '/' ? segmentName : "/" + segmentName;
+        int descriptor = create ? shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644)
+                                : shm_open(name.c_str(), O_RDONLY, 0);
+        if (descriptor < 0) throw runtime_error("Unable to open live metrics segment. " + segmentName);
+        struct stat info;
+        bool sized = create ? ftruncate(descriptor, static_cast<off_t>(length)) == 0
+                            : fstat(descriptor, &info) == 0 && static_cast<size_t>(info.st_size) >= length;
+        void* mapping = sized ? mmap(nullptr, length, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                                     descriptor, 0)
+                              : MAP_FAILED;
+        ::close(descriptor); // The mapping keeps the segment alive.
+        if (mapping == MAP_FAILED) {
+            if (create) shm_unlink(name.c_str());
+            throw runtime_error("Unable to map live metrics segment. " + segmentName);
+        }
+#endif
+        layout = static_cast<LiveMetricsLayout*>(mapping);
+        owner = create;
+        if (!create && (memcmp(layout->magic, LIVE_METRICS_MAGIC, sizeof(LIVE_METRICS_MAGIC)) != 0 ||
+                        layout->version != LIVE_METRICS_VERSION)) {
+            unmap();
+            throw runtime_error("Not a live metrics segment, or written by another version. " + segmentName);
+        }
+    }
+
+    // The simulation removes the name when it is done; readers that are still
+    // attached keep their mapping and see the final figures.
+    ~LiveMetricsSegment() {
+        unmap();
+#ifndef _WIN32
+        if (owner) shm_unlink(name.c_str());
+#endif
+    }
+
+    LiveMetricsSegment(const LiveMetricsSegment&) = delete;
+    LiveMetricsSegment& operator=(const LiveMetricsSegment&) = delete;
+
+    LiveMetricsLayout& metrics() { return *layout; }
+    const LiveMetricsLayout& metrics() const { return *layout; }
+
+private:
+    void unmap() {
+#ifdef _WIN32
+        UnmapViewOfFile(layout);
+        CloseHandle(mappingHandle);
+#else
+        munmap(layout, sizeof(LiveMetricsLayout));
+#endif
+    }
+
+    LiveMetricsLayout* layout = nullptr;
+    bool owner = false;
+#ifdef _WIN32
+    HANDLE mappingHandle = NULL;
+#else
+    string name;
+#endif
+};
+
+// Simulation side. Publishing is cheap, but it still only happens every
+// PUBLISH_INTERVAL of wall-clock time; the clock is read once every
+// CLOCK_STRIDE event times.
+class LiveMetricsPublisher {
+public:
+    static constexpr int CLOCK_STRIDE = 1024;
+    static constexpr double PUBLISH_INTERVAL = 0.1;   // Seconds.
+
+    LiveMetricsPublisher(const string& segmentName, const RouteTable& table)
+        : segment(segmentName, true), started(chrono::steady_clock::now()), lastPublish(started) {
+        LiveMetricsLayout& m = segment.metrics();
+        m.version = LIVE_METRICS_VERSION;
+        m.routeCount = static_cast<uint32_t>(table.routeCount());
+        for (int r = 0; r < table.routeCount(); r++) m.labels[r] = table.labels[r];
+        memcpy(m.magic, LIVE_METRICS_MAGIC, sizeof(LIVE_METRICS_MAGIC)); // Last: readers check it.
+    }
+
+    void arrival() { arrivals++; }
+
+    void maybePublish(int timeInstance, const RankState& rank) {
+        if (++rowsSinceClock < CLOCK_STRIDE) return;
+        rowsSinceClock = 0;
+        auto now = chrono::steady_clock::now();
+        if (chrono::duration<double>(now - lastPublish).count() >= PUBLISH_INTERVAL) {
+            publish(timeInstance, rank, rank.routeMetrics, now, false);
+        }
+    }
+
+    // By the end of a run the route metrics have moved into the summary.
+    void finish(const RankState& rank, const SimulationSummary& summary) {
+        publish(summary.endTime, rank, summary.routeMetrics, chrono::steady_clock::now(), true);
+    }
+
+private:
+    void publish(int timeInstance, const RankState& rank, const vector<RouteMetrics>& routeMetrics,
+                 chrono::steady_clock::time_point now, bool done) {
+        LiveMetricsLayout& m = segment.metrics();
+        double interval = chrono::duration<double>(now - lastPublish).count();
+        long long events = rank.eventsProcessed;
+
+        uint64_t sequence = m.sequence.load(memory_order_relaxed);
+        m.sequence.store(sequence + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        m.finished.store(done, memory_order_relaxed);
+        m.wallMillis.store(chrono::duration_cast<chrono::milliseconds>(now - started).count(), memory_order_relaxed);
+        m.simTime.store(timeInstance, memory_order_relaxed);
+        m.passengersArrived.store(arrivals, memory_order_relaxed);
+        m.passengersBoarded.store(rank.passengersBoarded, memory_order_relaxed);
+        m.waitingPassengers.store(rank.waitingPassengers, memory_order_relaxed);
+        m.departures.store(rank.departures, memory_order_relaxed);
+        m.eventsProcessed.store(events, memory_order_relaxed);
+        if (interval > 0.0) {
+            m.eventsPerSecond.store(static_cast<int64_t>((events - lastEvents) / interval), memory_order_relaxed);
+        }
+        for (uint32_t r = 0; r < m.routeCount; r++) {
+            m.queueDepth[r].store(rank.passengerQueues[r].size(), memory_order_relaxed);
+            m.routeBoarded[r].store(routeMetrics[r].wait.count(), memory_order_relaxed);
+            m.routeDepartures[r].store(routeMetrics[r].departures, memory_order_relaxed);
+        }
+
+        m.sequence.store(sequence + 2, memory_order_release);
+        lastPublish = now;
+        lastEvents = events;
+    }
+
+    LiveMetricsSegment segment;
+    chrono::steady_clock::time_point started;
+    chrono::steady_clock::time_point lastPublish;
+    long long lastEvents = 0;
+    long long arrivals = 0;
+    int rowsSinceClock = 0;
+};
+
+// Passes everything on to the inner writer and feeds the publisher, if any,
+// on the way. Without a publisher it costs one branch per row.
+template <typename Inner>
+class LiveMetricsWriter {
+public:
+    LiveMetricsWriter(Inner& writer, LiveMetricsPublisher* live) : inner(writer), publisher(live) {}
+
+    void begin(const RouteTable& table) { inner.begin(table); }
+    void arrival(const Passenger& p) {
+        if (publisher != nullptr) publisher->arrival();
+        inner.arrival(p);
+    }
+    void unknownRoute(const Passenger& p) { inner.unknownRoute(p); }
+    void row(int timeInstance, const RouteTable& table, const RankState& rank) {
+        inner.row(timeInstance, table, rank);
+        lastRank = &rank;
+        if (publisher != nullptr) publisher->maybePublish(timeInstance, rank);
+    }
+    void end(const SimulationSummary& summary) {
+        if (publisher != nullptr && lastRank != nullptr) publisher->finish(*lastRank, summary);
+        inner.end(summary);
+    }
+
+private:
+    Inner& inner;
+    LiveMetricsPublisher* publisher;
+    const RankState* lastRank = nullptr;
+};
+
+// One consistent copy of the segment, taken by a reader.
+struct LiveMetricsSnapshot {
+    uint64_t sequence = 0;
+    bool finished = false;
+    long long wallMillis = 0, simTime = 0, passengersArrived = 0, passengersBoarded = 0;
+    long long waitingPassengers = 0, departures = 0, eventsProcessed = 0, eventsPerSecond = 0;
+    vector<char> labels;
+    vector<long long> queueDepth, routeBoarded, routeDepartures;
+};
+
+// Seqlock read: retries while a write is in progress or one happened during
+// the copy. The simulation never waits for this.
+LiveMetricsSnapshot readLiveMetrics(const LiveMetricsLayout& m) {
+    LiveMetricsSnapshot s;
+    uint32_t routes = min<uint32_t>(m.routeCount, LIVE_METRICS_MAX_ROUTES);
+    s.labels.assign(m.labels, m.labels + routes);
+    s.queueDepth.resize(routes);
+    s.routeBoarded.resize(routes);
+    s.routeDepartures.resize(routes);
+    for (int idle = 0;; idle++) {
+        uint64_t before = m.sequence.load(memory_order_acquire);
+        if (before & 1) {
+            backOff(idle);
+            continue;
+        }
+        s.finished = m.finished.load(memory_order_relaxed) != 0;
+        s.wallMillis = m.wallMillis.load(memory_order_relaxed);
+        s.simTime = m.simTime.load(memory_order_relaxed);
+        s.passengersArrived = m.passengersArrived.load(memory_order_relaxed);
+        s.passengersBoarded = m.passengersBoarded.load(memory_order_relaxed);
+        s.waitingPassengers = m.waitingPassengers.load(memory_order_relaxed);
+        s.departures = m.departures.load(memory_order_relaxed);
+        s.eventsProcessed = m.eventsProcessed.load(memory_order_relaxed);
+        s.eventsPerSecond = m.eventsPerSecond.load(memory_order_relaxed);
+        for (uint32_t r = 0; r < routes; r++) {
+            s.queueDepth[r] = m.queueDepth[r].load(memory_order_relaxed);
+            s.routeBoarded[r] = m.routeBoarded[r].load(memory_order_relaxed);
+            s.routeDepartures[r] = m.routeDepartures[r].load(memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (m.sequence.load(memory_order_relaxed) == before) {
+            s.sequence = before;
+            return s;
+        }
+        backOff(idle);
+    }
+}
+
+void printLiveMetrics(ostream& out, const LiveMetricsSnapshot& s, bool json) {
+    if (json) {
+        out << "{\"wall_ms\":" << s.wallMillis << ",\"time\":" << s.simTime << ",\"arrived\":" << s.passengersArrived
+            << ",\"boarded\":" << s.passengersBoarded << ",\"waiting\":" << s.waitingPassengers
+            << ",\"departures\":" << s.departures << ",\"events\":" << s.eventsProcessed
+            << ",\"events_per_sec\":" << s.eventsPerSecond << ",\"finished\":" << (s.finished ? "true" : "false")
+            << ",\"routes\":[";
+        for (size_t r = 0; r < s.labels.size(); r++) {
+            out << (r > 0 ? "," : "") << "{\"route\":\"" << s.labels[r] << "\",\"queue\":" << s.queueDepth[r]
+                << ",\"boarded\":" << s.routeBoarded[r] << ",\"departures\":" << s.routeDepartures[r] << "}";
+        }
+        out << "]}\n";
+    } else {
+        out << "[" << fixed << setprecision(1) << s.wallMillis / 1000.0 << " s] time " << s.simTime << "  arrived "
+            << s.passengersArrived << "  boarded " << s.passengersBoarded << "  waiting " << s.waitingPassengers
+            << "  departures " << s.departures << "  events/s " << s.eventsPerSecond << "  queues";
+        for (size_t r = 0; r < s.labels.size(); r++) out << " " << s.labels[r] << "=" << s.queueDepth[r];
+        out << (s.finished ? "  (finished)" : "") << defaultfloat << "\n";
+    }
+    out.flush();
+}
+
+// Reader tool: attaches to a running simulation's segment and prints each new
+// snapshot until the run finishes.
+void watchLiveMetrics(const string& segmentName, int intervalMillis, bool json, ostream& out) {
+    LiveMetricsSegment segment(segmentName, false);
+    uint64_t lastSequence = 0;
+    while (true) {
+        LiveMetricsSnapshot snapshot = readLiveMetrics(segment.metrics());
+        if (snapshot.sequence != lastSequence) {
+            printLiveMetrics(out, snapshot, json);
+            lastSequence = snapshot.sequence;
+        }
+        if (snapshot.finished) return;
+        this_thread::sleep_for(chrono::milliseconds(intervalMillis));
+    }
+}
+
+// Calls run(writer) with the writer for the chosen output mode.
+template <typename Run>
+SimulationSummary withOutputWriter(OutputMode mode, size_t queuePreview, OutputBuffer& out, Run run) {
+    switch (mode) {
+    case OutputMode::Csv: {
+        CsvWriter writer(out);
+        return run(writer);
+    }
+    case OutputMode::Binary: {
+        BinaryRowWriter writer(out);
+        return run(writer);
+    }
+    case OutputMode::Summary: {
+        SummaryWriter writer(out);
+        return run(writer);
+    }
+    default: {
+        TableWriter writer(out, queuePreview);
+        return run(writer);
+    }
+    }
+}
+
+// Runs one simulation on from state with the writer for the chosen output mode
+// and the chosen boarding policy, publishing live metrics when live is set.
+template <typename ArrivalSource>
+SimulationSummary runWithOutput(ArrivalSource& arrivals, const RouteTable& table, OutputMode mode,
+                                size_t queuePreview, OutputBuffer& out, SimulationState& state,
+                                const CheckpointSchedule& checkpoints, const PolicyChoice& policyChoice,
+                                LiveMetricsPublisher* live) {
+    return withOutputWriter(mode, queuePreview, out, [&](auto& writer) {
+        LiveMetricsWriter<remove_reference_t<decltype(writer)>> liveWriter(writer, live);
+        return withPolicy(policyChoice, table, [&](auto& policy) {
+            return continueSimulation(arrivals, table, liveWriter, state, checkpoints, policy);
+        });
+    });
+}
+
+// Route-partitioned execution. Routes never share passengers or taxis, so the
+// routes are split into shards, balanced by passenger count, and each shard
+// simulates its routes on its own thread. For every time instance a shard
+// reports its waiting totals and, when rows are rendered, how many passengers
+// left each of its queues and the seats and status of each of its taxis. The
+// reports travel in blocks through one bounded SPSC ring per shard. The
+// calling thread merges them by time; for a writer that renders rows it also
+// rebuilds the queues from the trace and drives the writer, so the rows and
+// the summary match a single-threaded run. Otherwise it only combines the
+// waiting totals (for the peak queue length) and the shards' own summaries.
+// As with checkpoints, the trace is expected in arrival order.
+const size_t SHARD_BLOCK_TICKS = 4096;
+const size_t SHARD_BLOCKS_IN_FLIGHT = 8;
+
+struct RouteShard {
+    RouteTable table;
+    vector<int> globalRoute;        // Route index in the full table, per shard route.
+    vector<int> globalTaxi;         // Taxi number in the full table, per shard taxi.
+    vector<Passenger> passengers;
+};
+
+// Writer for one shard. Record layout, one int64 per field:
+//   time, waiting after this time's arrivals, waiting at the end of the time,
+//   1 when the shard has nothing left to do, events processed so far,
+//   and with detail: passengers taken from each route queue, then free seats
+//   and status per taxi.
+class ShardTickWriter {
+public:
+    ShardTickWriter(SpscRing<vector<int64_t>>& blocks, const atomic<bool>& stop, size_t passengers, bool detail)
+        : ring(blocks), stopRequested(stop), shardPassengers(passengers), withDetail(detail) {}
+
+    static size_t recordSize(const RouteTable& table, bool detail) {
+        return detail ? 5 + table.routeCount() + 2 * table.totalTaxis() : 5;
+    }
+
+    void begin(const RouteTable& table) {
+        routes = &table;
+        queueSize.assign(table.routeCount(), 0);
+        arrivalsNow.assign(table.routeCount(), 0);
+        block.reserve(SHARD_BLOCK_TICKS * recordSize(table, withDetail));
+    }
+    void arrival(const Passenger& p) {
+        arrivalsNow[routes->routeIndex(p.routeType)]++;
+        arrived++;
+    }
+    void unknownRoute(const Passenger&) {}
+    void row(int timeInstance, const RouteTable& table, const RankState& rank) {
+        long long arrivedNow = 0;
+        for (long long count : arrivalsNow) arrivedNow += count;
+        block.push_back(timeInstance);
+        block.push_back(static_cast<int64_t>(waitingBefore + arrivedNow));
+        block.push_back(static_cast<int64_t>(rank.waitingPassengers));
+        block.push_back(arrived == shardPassengers && rank.waitingPassengers == 0 && rank.activeBoardings == 0);
+        block.push_back(rank.eventsProcessed);
+        for (int r = 0; r < table.routeCount(); r++) {
+            if (withDetail) {
+                long long size = static_cast<long long>(rank.passengerQueues[r].size());
+                block.push_back(queueSize[r] + arrivalsNow[r] - size);
+                queueSize[r] = size;
+            }
+            arrivalsNow[r] = 0;
+        }
+        for (int taxi = 0; withDetail && taxi < table.totalTaxis(); taxi++) {
+            block.push_back(rank.currentCapacity[taxi]);
+            block.push_back(static_cast<int64_t>(rank.status[taxi]));
+        }
+        waitingBefore = rank.waitingPassengers;
+        if (block.size() >= SHARD_BLOCK_TICKS * recordSize(table, withDetail)) flush();
+    }
+    void end(const SimulationSummary&) { flush(); }
+
+    struct Stopped {};
+
+private:
+    void flush() {
+        if (block.empty()) return;
+        for (int idle = 0; !ring.tryPush(move(block)); idle++) {
+            if (stopRequested.load(memory_order_relaxed)) throw Stopped();
+            backOff(idle);
+        }
+        block = vector<int64_t>();
+        block.reserve(SHARD_BLOCK_TICKS * recordSize(*routes, withDetail));
+    }
+
+    SpscRing<vector<int64_t>>& ring;
+    const atomic<bool>& stopRequested;
+    const RouteTable* routes = nullptr;
+    size_t shardPassengers;
+    bool withDetail;
+    size_t arrived = 0;
+    size_t waitingBefore = 0;
+    vector<long long> queueSize;
+    vector<long long> arrivalsNow;
+    vector<int64_t> block;
+};
+
+// Splits the routes into at most shardCount shards. Routes go to the shard
+// with the fewest passengers so far, busiest route first. The merge replays
+// arrivals in file order, so the trace must be in arrival order.
+vector<RouteShard> partitionRoutes(const vector<Passenger>& passengerList, const RouteTable& table, int shardCount) {
+    bool sorted = is_sorted(passengerList.begin(), passengerList.end(),
+                            [](const Passenger& a, const Passenger& b) { return a.arrivalTime < b.arrivalTime; });
+    if (!sorted) throw runtime_error("route shards need a trace in arrival order; use --sort");
+    int routes = table.routeCount();
+    shardCount = max(1, min(shardCount, routes));
+    vector<long long> routeLoad(routes, 0);
+    for (const Passenger& p : passengerList) {
+        int route = table.routeIndex(p.routeType);
+        if (route >= 0) routeLoad[route]++;
+    }
+    vector<int> order(routes);
+    for (int r = 0; r < routes; r++) order[r] = r;
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return routeLoad[a] > routeLoad[b]; });
+    vector<long long> shardLoad(shardCount, 0);
+    vector<int> shardOf(routes);
+    for (int r : order) {
+        int lightest = static_cast<int>(min_element(shardLoad.begin(), shardLoad.end()) - shardLoad.begin());
+        shardOf[r] = lightest;
+        shardLoad[lightest] += routeLoad[r] + 1;
+    }
+
+    vector<RouteShard> shards(shardCount);
+    for (int r = 0; r < routes; r++) {
+        RouteShard& shard = shards[shardOf[r]];
+        shard.table.addRoute(table.labels[r], table.taxiCount[r], table.capacity[r]);
+        shard.globalRoute.push_back(r);
+        for (int k = 0; k < table.taxiCount[r]; k++) shard.globalTaxi.push_back(table.firstTaxi[r] + k);
+    }
+    for (int s = 0; s < shardCount; s++) shards[s].passengers.reserve(shardLoad[s]);
+    for (const Passenger& p : passengerList) {
+        int route = table.routeIndex(p.routeType);
+        if (route >= 0) shards[shardOf[route]].passengers.push_back(p);
+    }
+    return shards;
+}
+
+template <typename Writer>
+SimulationSummary runPartitioned(const vector<Passenger>& passengerList, const RouteTable& table, Writer& writer,
+                                 int threadCount) {
+    vector<RouteShard> shards = partitionRoutes(passengerList, table, threadCount);
+    int shardCount = static_cast<int>(shards.size());
+    const bool detail = WritesRows<Writer>::value;
+
+    // Start every shard, all with the clock of the whole run.
+    vector<unique_ptr<SpscRing<vector<int64_t>>>> rings;
+    for (int s = 0; s < shardCount; s++) rings.emplace_back(new SpscRing<vector<int64_t>>(SHARD_BLOCKS_IN_FLIGHT));
+    vector<SimulationSummary> shardSummaries(shardCount);
+    vector<exception_ptr> shardErrors(shardCount);
+    unique_ptr<atomic<bool>[]> shardFinished(new atomic<bool>[shardCount]);
+    atomic<bool> stopRequested{false};
+    vector<thread> threads;
+    for (int s = 0; s < shardCount; s++) {
+        shardFinished[s].store(false);
+        threads.emplace_back([&, s]() {
+            try {
+                const RouteShard& shard = shards[s];
+                SimulationState state(shard.table);
+                state.drainEvents = true;
+                if (!passengerList.empty()) state.startAt(passengerList.front().arrivalTime);
+                ShardTickWriter shardWriter(*rings[s], stopRequested, shard.passengers.size(), detail);
+                VectorArrivalSource arrivals(shard.passengers);
+                shardSummaries[s] = continueSimulation(arrivals, shard.table, shardWriter, state);
+            } catch (const ShardTickWriter::Stopped&) {
+            } catch (...) {
+                shardErrors[s] = current_exception();
+            }
+            shardFinished[s].store(true, memory_order_release);
+        });
+    }
+    auto joinAll = [&]() {
+        for (thread& t : threads) {
+            if (t.joinable()) t.join();
+        }
+    };
+
+    // The next record of a shard, or nullptr once the shard has finished.
+    vector<vector<int64_t>> current(shardCount);
+    vector<size_t> offset(shardCount, 0);
+    auto nextRecord = [&](int s) -> const int64_t* {
+        if (offset[s] < current[s].size()) return current[s].data() + offset[s];
+        for (int idle = 0;; idle++) {
+            vector<int64_t>* block = rings[s]->front();
+            if (block == nullptr && shardFinished[s].load(memory_order_acquire)) block = rings[s]->front();
+            if (block != nullptr) {
+                current[s] = move(*block);
+                rings[s]->pop();
+                offset[s] = 0;
+                return current[s].data();
+            }
+            if (shardFinished[s].load(memory_order_acquire)) {
+                if (shardErrors[s]) rethrow_exception(shardErrors[s]);
+                return nullptr;
+            }
+            backOff(idle);
+        }
+    };
+
+    SimulationSummary summary;
+    try {
+        RankState view(table);   // What the writer sees: the whole rank, rebuilt from the shards.
+        vector<int64_t> waitingAfter(shardCount, 0);
+        vector<int64_t> shardEvents(shardCount, 0);
+        vector<unsigned char> shardComplete(shardCount);
+        for (int s = 0; s < shardCount; s++) shardComplete[s] = shards[s].passengers.empty();
+        size_t nextArrival = 0;
+        bool started = false;
+
+        // Without rows, the trace only matters for its counts and its first and
+        // last arrival times: the run cannot end before everyone, known route or
+        // not, has arrived.
+        bool lastArrivalPending = false;
+        if (!detail && !passengerList.empty()) {
+            nextArrival = passengerList.size();
+            summary.passengersArrived = passengerList.size();
+            summary.unknownRoutePassengers = passengerList.size();
+            for (const RouteShard& shard : shards) summary.unknownRoutePassengers -= shard.passengers.size();
+            summary.startTime = passengerList.front().arrivalTime;
+            started = true;
+            lastArrivalPending = true;
+        }
+
+        writer.begin(table);
+        while (true) {
+            long long timeInstance = LLONG_MAX;
+            if (nextArrival < passengerList.size()) timeInstance = passengerList[nextArrival].arrivalTime;
+            if (lastArrivalPending) timeInstance = passengerList.back().arrivalTime;
+            for (int s = 0; s < shardCount; s++) {
+                const int64_t* record = nextRecord(s);
+                if (record != nullptr) timeInstance = min<long long>(timeInstance, record[0]);
+            }
+            if (timeInstance == LLONG_MAX) break;
+            lastArrivalPending = lastArrivalPending && timeInstance < passengerList.back().arrivalTime;
+            if (!started) {
+                summary.startTime = static_cast<int>(timeInstance);
+                started = true;
+            }
+
+            while (nextArrival < passengerList.size() && passengerList[nextArrival].arrivalTime <= timeInstance) {
+                const Passenger& p = passengerList[nextArrival++];
+                writer.arrival(p);
+                int route = table.routeIndex(p.routeType);
+                if (route >= 0) {
+                    view.passengerQueues[route].push(p);
+                } else {
+                    summary.unknownRoutePassengers++;
+                    writer.unknownRoute(p);
+                }
+                summary.passengersArrived++;
+            }
+
+            size_t waitingNow = 0;
+            view.waitingPassengers = 0;
+            for (int s = 0; s < shardCount; s++) {
+                const int64_t* record = nextRecord(s);
+                if (record == nullptr || record[0] != timeInstance) {
+                    waitingNow += waitingAfter[s];
+                    view.waitingPassengers += waitingAfter[s];
+                    continue;
+                }
+                const RouteShard& shard = shards[s];
+                waitingNow += record[1];
+                waitingAfter[s] = record[2];
+                view.waitingPassengers += record[2];
+                shardComplete[s] = record[3] != 0;
+                shardEvents[s] = record[4];
+                if (detail) {
+                    const int64_t* field = record + 5;
+                    for (int globalRoute : shard.globalRoute) {
+                        for (int64_t taken = *field++; taken > 0; taken--) view.passengerQueues[globalRoute].pop();
+                    }
+                    for (int globalTaxi : shard.globalTaxi) {
+                        view.currentCapacity[globalTaxi] = static_cast<int>(*field++);
+                        view.status[globalTaxi] = static_cast<TaxiStatus>(*field++);
+                    }
+                }
+                offset[s] += ShardTickWriter::recordSize(shard.table, detail);
+            }
+            summary.peakQueueLength = max(summary.peakQueueLength, waitingNow);
+
+            if (detail) writer.row(static_cast<int>(timeInstance), table, view);
+
+            bool complete = nextArrival == passengerList.size() && !lastArrivalPending;
+            for (int s = 0; complete && s < shardCount; s++) complete = shardComplete[s] != 0;
+            if (complete) {
+                summary.endTime = static_cast<int>(timeInstance);
+                break;
+            }
+        }
+
+        // Shards may still report departures after the end; they are dropped.
+        for (int s = 0; s < shardCount; s++) {
+            while (nextRecord(s) != nullptr) offset[s] = current[s].size();
+        }
+        joinAll();
+        for (int s = 0; s < shardCount; s++) {
+            if (shardErrors[s]) rethrow_exception(shardErrors[s]);
+        }
+
+        summary.eventsProcessed = summary.unknownRoutePassengers;
+        for (int64_t events : shardEvents) summary.eventsProcessed += events;
+        summary.routeMetrics.resize(table.routeCount());
+        for (int s = 0; s < shardCount; s++) {
+            const SimulationSummary& part = shardSummaries[s];
+            summary.passengersBoarded += part.passengersBoarded;
+            summary.totalWait += part.totalWait;
+            summary.departures += part.departures;
+            summary.queueLengthArea += part.queueLengthArea;
+            for (size_t r = 0; r < part.routeMetrics.size(); r++) {
+                summary.routeMetrics[shards[s].globalRoute[r]] = part.routeMetrics[r];
+            }
+        }
+        for (const RouteMetrics& metrics : summary.routeMetrics) summary.waitHistogram.merge(metrics.wait);
+    } catch (...) {
+        stopRequested.store(true);
+        joinAll();
+        throw;
+    }
+    writer.end(summary);
+    return summary;
+}
+
+// Real-time dispatcher. The same boarding rules as processTaxiRoute, run
+// against the wall clock by threads instead of replayed by the event loop:
+// producer threads inject the trace's passengers into per-route queues as
+// their arrival times come round, and taxi worker threads board and send off
+// the taxis they own. Only the route queues are shared, so they are the only
+// synchronisation. The replay runs at --replay-rate trace time units per
+// second; a rate of 0 injects everything at once and boards instantly, which
+// measures the dispatcher itself rather than the trace.
+
+// Bounded lock-free queue for many producers and many consumers (Vyukov's
+// design). Each cell carries a sequence number that says whether it is ready
+// to be written or read for the current lap of the ring, so producers and
+// consumers claim cells with one CAS on their own index and never touch a
+// lock.
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    // Returns false when the queue is full.
+    bool tryPush(const T& item) {
+        size_t position = enqueueIndex.load(memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(memory_order_acquire);
+            intptr_t lap = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (lap == 0) {
+                if (enqueueIndex.compare_exchange_weak(position, position + 1, memory_order_relaxed)) break;
+            } else if (lap < 0) {
+                return false;
+            } else {
+                position = enqueueIndex.load(memory_order_relaxed);
+            }
+        }
+        cell->value = item;
+        cell->sequence.store(position + 1, memory_order_release);
+        return true;
+    }
+
+    // Returns false when the queue is empty.
+    bool tryPop(T& item) {
+        size_t position = dequeueIndex.load(memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(memory_order_acquire);
+            intptr_t lap = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (lap == 0) {
+                if (dequeueIndex.compare_exchange_weak(position, position + 1, memory_order_relaxed)) break;
+            } else if (lap < 0) {
+                return false;
+            } else {
+                position = dequeueIndex.load(memory_order_relaxed);
+            }
+        }
+        item = cell->value;
+        cell->sequence.store(position + mask + 1, memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) atomic<size_t> enqueueIndex{0};
+    alignas(64) atomic<size_t> dequeueIndex{0};
+};
+
+const size_t DISPATCH_QUEUE_CAPACITY = 1 << 16;
+
+// A passenger in a route queue, with the wall-clock time it was due to arrive.
+struct DispatchTicket {
+    Passenger passenger;
+    int64_t dueNanos;
+};
+
+// Results of one load-test run.
+struct DispatchResult {
+    int producers = 0;
+    int workers = 0;
+    double seconds = 0.0;
+    long long boarded = 0;
+    long long departures = 0;
+    long long producerStalls = 0;     // Pushes that found a route queue full.
+    LogHistogram latency;             // Due arrival to boarding start, nanoseconds.
+};
+
+// Runs the trace through the dispatcher once.
+DispatchResult runDispatcher(const vector<Passenger>& passengerList, const RouteTable& table, int producers,
+                             int workers, double replayRate) {
+    DispatchResult result;
+    result.producers = max(1, producers);
+    result.workers = max(1, min(workers, table.totalTaxis()));
+    double unitNanos = replayRate > 0.0 ? 1e9 / replayRate : 0.0;
+
+    vector<unique_ptr<MpmcQueue<DispatchTicket>>> routeQueues;
+    for (int r = 0; r < table.routeCount(); r++) {
+        routeQueues.emplace_back(new MpmcQueue<DispatchTicket>(DISPATCH_QUEUE_CAPACITY));
+    }
+    long long known = 0;
+    for (const Passenger& p : passengerList) known += table.routeIndex(p.routeType) >= 0;
+    atomic<long long> remaining(known);
+    atomic<long long> stalls(0);
+    vector<DispatchResult> workerResults(result.workers);
+
+    int firstArrival = passengerList.empty() ? 0 : passengerList.front().arrivalTime;
+    auto start = chrono::steady_clock::now() + chrono::milliseconds(10); // Lets every thread get going.
+    auto nanosSince = [&](chrono::steady_clock::time_point t) {
+        return chrono::duration_cast<chrono::nanoseconds>(t - start).count();
+    };
+
+    // Producer p injects passengers p, p + P, p + 2P, ... so each producer's
+    // share is in arrival order and spread over the whole trace. Latency is
+    // measured from when a passenger was due, not from when it was pushed, so
+    // a producer that falls behind shows up in the tail instead of hiding it.
+    auto producer = [&](int self) {
+        long long localStalls = 0;
+        for (size_t i = self; i < passengerList.size(); i += result.producers) {
+            const Passenger& p = passengerList[i];
+            int route = table.routeIndex(p.routeType);
+            if (route < 0) continue;
+            int64_t due = static_cast<int64_t>((p.arrivalTime - firstArrival) * unitNanos);
+            for (int64_t early = due - nanosSince(chrono::steady_clock::now()); early > 0;
+                 early = due - nanosSince(chrono::steady_clock::now())) {
+                if (early > 200000) this_thread::sleep_for(chrono::nanoseconds(early - 100000));
+                else this_thread::yield();
+            }
+            DispatchTicket ticket = {p, due};
+            for (int idle = 0; !routeQueues[route]->tryPush(ticket); idle++) {
+                localStalls++;
+                backOff(idle);
+            }
+        }
+        stalls += localStalls;
+    };
+
+    // Worker w owns taxis w, w + W, w + 2W, ... and applies processTaxiRoute's
+    // rules to each in turn: a full taxi leaves and is replaced one time unit
+    // later, and a free taxi takes the next passenger of its route, who is
+    // seated max(1, boardingTime) units later.
+    auto worker = [&](int self) {
+        DispatchResult& local = workerResults[self];
+        vector<int> taxis;
+        for (int taxi = self; taxi < table.totalTaxis(); taxi += result.workers) taxis.push_back(taxi);
+        size_t count = taxis.size();
+        vector<int> seatsLeft(count), boarding(count, 0);
+        vector<TaxiStatus> status(count, TaxiStatus::Waiting);
+        vector<int64_t> readyAt(count, 0);   // Boarding completes, or replacement taxi arrives.
+        for (size_t k = 0; k < count; k++) seatsLeft[k] = table.capacity[table.taxiRoute[taxis[k]]];
+        int boardingTaxis = 0;               // Keep going until these are seated, even once the queues are done.
+
+        for (int idle = 0; remaining.load(memory_order_relaxed) > 0 || boardingTaxis > 0;) {
+            bool progress = false;
+            int64_t now = nanosSince(chrono::steady_clock::now());
+            for (size_t k = 0; k < count; k++) {
+                int route = table.taxiRoute[taxis[k]];
+                if (status[k] == TaxiStatus::Departed) {
+                    if (now < readyAt[k]) continue;
+                    seatsLeft[k] = table.capacity[route]; // Empty taxi pulls in.
+                    status[k] = TaxiStatus::Waiting;
+                }
+                if (boarding[k]) {
+                    if (now < readyAt[k]) continue;
+                    boarding[k] = 0;
+                    boardingTaxis--;
+                    status[k] = TaxiStatus::Board;
+                    if (--seatsLeft[k] == 0) {
+                        status[k] = TaxiStatus::Departed;
+                        readyAt[k] += static_cast<int64_t>(unitNanos);
+                        local.departures++;
+                        progress = true;
+                        continue;
+                    }
+                }
+                DispatchTicket ticket;
+                if (!routeQueues[route]->tryPop(ticket)) continue;
+                now = nanosSince(chrono::steady_clock::now());
+                local.latency.record(now - ticket.dueNanos);
+                local.boarded++;
+                remaining.fetch_sub(1, memory_order_relaxed);
+                boarding[k] = 1;
+                boardingTaxis++;
+                readyAt[k] = now + static_cast<int64_t>(max(1, ticket.passenger.boardingTime) * unitNanos);
+                progress = true;
+            }
+            if (progress) idle = 0;
+            else backOff(idle++);
+        }
+    };
+
+    vector<thread> threads;
+    for (int p = 0; p < result.producers; p++) threads.emplace_back(producer, p);
+    for (int w = 0; w < result.workers; w++) threads.emplace_back(worker, w);
+    for (thread& t : threads) t.join();
+
+    result.seconds = nanosSince(chrono::steady_clock::now()) / 1e9;
+    result.producerStalls = stalls.load();
+    for (const DispatchResult& w : workerResults) {
+        result.boarded += w.boarded;
+        result.departures += w.departures;
+        result.latency.merge(w.latency);
+    }
+    return result;
+}
+
+// Load-test driver: replays the trace through the dispatcher once per worker
+// count and reports sustained throughput and latency percentiles.
+void runDispatchLoadTest(const vector<Passenger>& passengerList, const RouteTable& table,
+                         const vector<uint64_t>& workerCounts, int producers, double replayRate, ostream& out) {
+    out << "Dispatcher load test: " << passengerList.size() << " passengers, " << table.routeCount() << " routes, "
+        << table.totalTaxis() << " taxis, " << producers << " producer" << (producers == 1 ? "" : "s") << ", ";
+    if (replayRate > 0.0) out << "replay at " << replayRate << " time units/s\n\n";
+    else out << "replay as fast as possible\n\n";
+    out << right << setw(8) << "Workers" << setw(10) << "Seconds" << setw(11) << "Boarded" << setw(13) << "Pax/sec"
+        << setw(11) << "p50 us" << setw(11) << "p99 us" << setw(11) << "p99.9 us" << setw(11) << "Max us"
+        << setw(9) << "Stalls" << "\n";
+    for (uint64_t workers : workerCounts) {
+        DispatchResult r = runDispatcher(passengerList, table, producers, static_cast<int>(workers), replayRate);
+        double throughput = r.seconds > 0.0 ? r.boarded / r.seconds : 0.0;
+        out << setw(8) << r.workers << fixed << setprecision(3) << setw(10) << r.seconds << setw(11) << r.boarded
+            << setprecision(0) << setw(13) << throughput << setprecision(1)
+            << setw(11) << r.latency.percentile(0.50) / 1e3 << setw(11) << r.latency.percentile(0.99) / 1e3
+            << setw(11) << r.latency.percentile(0.999) / 1e3 << setw(11) << r.latency.largest() / 1e3
+            << setw(9) << r.producerStalls << defaultfloat << "\n" << flush;
+    }
+}
+
+
+// Synthetic workload generator. Passengers arrive in groups ("epochs") from a
+// Poisson process whose intensity is either constant or follows a daily
+// profile; an epoch is a single passenger, or with the burst probability a
+// whole group for one route. Routes are drawn from the route mix and boarding
+// times from the chosen distribution.
+//
+// The trace is cut into fixed-size chunks, and each chunk has its own random
+// streams seeded from the base seed and the chunk number, so a given seed
+// gives the same bytes whatever --threads is. Arrival times are generated in
+// operational time (one unit per expected epoch), where the gaps do not
+// depend on the clock. A first pass adds up each chunk's span; the second
+// pass regenerates the chunks from their known start and maps operational
+// time back to clock time through the inverse cumulative intensity.
+enum class ArrivalPattern { Poisson, Diurnal };
+enum class BoardingDistribution { Fixed, Uniform, Exponential };
+
+const uint64_t GENERATOR_CHUNK_ROWS = 1 << 18;
+const int MAX_GENERATED_BOARDING = 0xFFFF;
+
+// Relative arrival intensity for each hour of the day: quiet at night, with
+// morning and evening commuter peaks. Normalized to a mean of 1 before use.
+const double DIURNAL_PROFILE[24] = {0.2, 0.1, 0.1, 0.1, 0.2, 0.5, 1.2, 2.2, 2.4, 1.5, 1.0, 1.0,
+                                    1.1, 1.0, 1.0, 1.2, 1.8, 2.4, 2.2, 1.4, 0.9, 0.6, 0.4, 0.3};
+
+struct WorkloadSpec {
+    uint64_t rows = 0;
+    double rate = 1.0;                 // Mean passengers per time unit.
+    ArrivalPattern pattern = ArrivalPattern::Poisson;
+    double dayLength = 1440.0;         // Time units per day for the diurnal profile.
+    vector<char> routes;               // Empty means every route in the route table, equally.
+    vector<double> routeWeights;
+    double burstProbability = 0.0;
+    int burstSize = 1;
+    BoardingDistribution boarding = BoardingDistribution::Fixed;
+    double boardingFirst = 2.0;        // Fixed value, uniform lower bound or exponential mean.
+    double boardingLast = 2.0;         // Uniform upper bound.
+    double priorityShare = 0.0;        // Fraction of passengers flagged as priority (CSV only).
+    bool binary = false;
+};
+
+bool parseRouteMix(const string& text, WorkloadSpec& spec) {
+    spec.routes.clear();
+    spec.routeWeights.clear();
+    stringstream parts(text);
+    string part;
+    while (getline(parts, part, ',')) {
+        if (part.size() < 3 || part[1] != '=') return false;
+        char* end = nullptr;
+        double weight = strtod(part.c_str() + 2, &end);
+        if (*end != '\0' || !(weight >= 0.0)) return false;
+        spec.routes.push_back(part[0]);
+        spec.routeWeights.push_back(weight);
+    }
+    return !spec.routes.empty();
+}
+
+// "fixed:v", "uniform:a:b" or "exponential:mean".
+bool parseBoardingDistribution(const string& text, WorkloadSpec& spec) {
+    string kind = text.substr(0, text.find(':'));
+    double first = 0.0, last = 0.0;
+    int fields = 0;
+    if (kind == "fixed" || kind == "exponential") {
+        fields = sscanf(text.c_str() + kind.size(), ":%lf", &first);
+        last = first;
+        if (fields != 1) return false;
+    } else if (kind == "uniform") {
+        fields = sscanf(text.c_str() + kind.size(), ":%lf:%lf", &first, &last);
+        if (fields != 2) return false;
+    } else {
+        return false;
+    }
+    if (!(first >= 1.0) || last < first || last > MAX_GENERATED_BOARDING) return false;
+    spec.boarding = kind == "fixed" ? BoardingDistribution::Fixed
+                  : kind == "uniform" ? BoardingDistribution::Uniform : BoardingDistribution::Exponential;
+    spec.boardingFirst = floor(first);
+    spec.boardingLast = floor(last);
+    return true;
+}
+
+class WorkloadGenerator {
+public:
+    WorkloadGenerator(const WorkloadSpec& spec, const RouteTable& table, uint64_t seed)
+        : spec(spec), seed(seed) {
+        routes = spec.routes;
+        vector<double> weights = spec.routeWeights;
+        if (routes.empty()) {
+            routes = table.labels;
+            weights.assign(routes.size(), 1.0);
+        }
+        double total = 0.0;
+        for (double w : weights) total += w;
+        if (!(total > 0.0)) throw runtime_error("The route mix needs at least one positive weight.");
+        for (double w : weights) {
+            double previous = cumulativeRouteWeight.empty() ? 0.0 : cumulativeRouteWeight.back();
+            cumulativeRouteWeight.push_back(previous + w / total);
+        }
+        cumulativeRouteWeight.back() = 1.0;
+
+        double meanEpochRows = 1.0 + spec.burstProbability * (spec.burstSize - 1);
+        epochRate = spec.rate / meanEpochRows;
+
+        // Cumulative operational time at the start of each hour of the day.
+        double profileTotal = 0.0;
+        for (double weight : DIURNAL_PROFILE) profileTotal += weight;
+        double hourLength = spec.dayLength / 24.0;
+        hourStart[0] = 0.0;
+        for (int h = 0; h < 24; h++) {
+            hourIntensity[h] = epochRate * DIURNAL_PROFILE[h] * 24.0 / profileTotal;
+            hourStart[h + 1] = hourStart[h] + hourIntensity[h] * hourLength;
+        }
+        hourStart[24] = epochRate * spec.dayLength;
+    }
+
+    uint64_t chunkCount() const { return (spec.rows + GENERATOR_CHUNK_ROWS - 1) / GENERATOR_CHUNK_ROWS; }
+
+    uint64_t chunkRows(uint64_t chunk) const {
+        return min(GENERATOR_CHUNK_ROWS, spec.rows - chunk * GENERATOR_CHUNK_ROWS);
+    }
+
+    // Operational time from the chunk's start to its last epoch.
+    double chunkSpan(uint64_t chunk) const {
+        SplitMix64 timing(replicationSeed(seed, 2 * chunk));
+        double local = 0.0;
+        for (uint64_t produced = 0, rows = chunkRows(chunk); produced < rows;) {
+            local += -log(1.0 - timing.uniform());
+            produced += epochSize(timing);
+        }
+        return local;
+    }
+
+    // Clock time of an operational time.
+    double clockTime(double operational) const {
+        if (spec.pattern == ArrivalPattern::Poisson) return operational / epochRate;
+        double days = floor(operational / hourStart[24]);
+        double rest = operational - days * hourStart[24];
+        int hour = static_cast<int>(upper_bound(hourStart, hourStart + 25, rest) - hourStart) - 1;
+        hour = max(0, min(hour, 23));
+        double hourLength = spec.dayLength / 24.0;
+        return days * spec.dayLength + hour * hourLength + (rest - hourStart[hour]) / hourIntensity[hour];
+    }
+
+    int arrivalTime(double operational) const {
+        double clock = clockTime(operational);
+        if (clock > INT_MAX) throw runtime_error("Generated arrival times overflow; raise --rate or lower the row count.");
+        return static_cast<int>(clock);
+    }
+
+    // Calls emit(passenger) for every row of the chunk, in arrival order.
+    // start is the operational time of the previous chunk's last epoch.
+    template <typename Emit>
+    void generateChunk(uint64_t chunk, double start, Emit emit) const {
+        SplitMix64 timing(replicationSeed(seed, 2 * chunk));
+        SplitMix64 detail(replicationSeed(seed, 2 * chunk + 1));
+        double local = 0.0;
+        for (uint64_t produced = 0, rows = chunkRows(chunk); produced < rows;) {
+            local += -log(1.0 - timing.uniform());
+            uint64_t group = min<uint64_t>(epochSize(timing), rows - produced);
+            int arrival = arrivalTime(start + local);
+            char route = drawRoute(detail);
+            for (uint64_t i = 0; i < group; i++) {
+                int boardingTime = drawBoarding(detail);
+                unsigned char priority = spec.priorityShare > 0.0 && detail.uniform() < spec.priorityShare;
+                emit(Passenger{route, priority, boardingTime, arrival});
+            }
+            produced += group;
+        }
+    }
+
+private:
+    const WorkloadSpec& spec;
+    uint64_t seed;
+    vector<char> routes;
+    vector<double> cumulativeRouteWeight;
+    double epochRate;
+    double hourIntensity[24];
+    double hourStart[25];
+
+    uint64_t epochSize(SplitMix64& timing) const {
+        if (spec.burstProbability <= 0.0) return 1;
+        return timing.uniform() < spec.burstProbability ? spec.burstSize : 1;
+    }
+
+    char drawRoute(SplitMix64& detail) const {
+        if (routes.size() == 1) return routes[0];
+        double u = detail.uniform();
+        size_t r = upper_bound(cumulativeRouteWeight.begin(), cumulativeRouteWeight.end(), u) -
+                   cumulativeRouteWeight.begin();
+        return routes[min(r, routes.size() - 1)];
+    }
+
+    int drawBoarding(SplitMix64& detail) const {
+        switch (spec.boarding) {
+        case BoardingDistribution::Fixed:
+            return static_cast<int>(spec.boardingFirst);
+        case BoardingDistribution::Uniform:
+            return static_cast<int>(spec.boardingFirst) +
+                   static_cast<int>(detail.below(static_cast<uint64_t>(spec.boardingLast - spec.boardingFirst) + 1));
+        case BoardingDistribution::Exponential:
+        default: {
+            double value = floor(-log(1.0 - detail.uniform()) * spec.boardingFirst + 0.5);
+            return static_cast<int>(max(1.0, min(value, static_cast<double>(MAX_GENERATED_BOARDING))));
+        }
+        }
+    }
+};
+
+// Writes spec.rows generated passengers to filename as CSV or as a binary
+// trace. Chunks are formatted in parallel, one wave of chunks per thread at a
+// time, and written in order, so memory stays bounded at any trace size.
+// Binary traces know every column's offset from the row count, so the route
+// and boarding columns are written in place and the arrival column appended.
+void generateWorkload(const WorkloadSpec& spec, const RouteTable& table, uint64_t seed, int threadCount,
+                      const string& filename) {
+    if (spec.rows == 0) throw runtime_error("Nothing to generate.");
+    WorkloadGenerator generator(spec, table, seed);
+    auto started = chrono::steady_clock::now();
+
+    // Pass 1: the operational start of every chunk.
+    uint64_t chunks = generator.chunkCount();
+    vector<double> span(chunks);
+    parallelFor(chunks, threadCount, [&](size_t c) { span[c] = generator.chunkSpan(c); });
+    vector<double> chunkStart(chunks + 1, 0.0);
+    for (uint64_t c = 0; c < chunks; c++) chunkStart[c + 1] = chunkStart[c] + span[c];
+    int lastArrival = generator.arrivalTime(chunkStart[chunks]);
+
+    int boardingWidth = spec.boardingLast > 0xFF ? 2 : 1;
+    if (spec.boarding == BoardingDistribution::Exponential) boardingWidth = 2;
+
+    ofstream file(filename, ios::binary | ios::trunc);
+    if (!file.is_open()) throw runtime_error("Unable to open output file. " + filename);
+    uint64_t routeOffset = BINARY_TRACE_HEADER_SIZE;
+    uint64_t boardingOffset = routeOffset + spec.rows;
+    uint64_t arrivalOffset = boardingOffset + spec.rows * boardingWidth;
+    uint64_t arrivalBytes = 0;
+    if (spec.binary) {
+        string header = binaryTraceHeader(boardingWidth, spec.rows, 0);
+        file.write(header.data(), header.size());
+    }
+
+    // Pass 2: format a wave of chunks in parallel, then write it in order.
+    size_t wave = max(1, threadCount);
+    vector<string> text(wave), routeColumn(wave), boardingColumn(wave);
+    uint64_t bytesWritten = 0;
+    for (uint64_t first = 0; first < chunks; first += wave) {
+        size_t count = min<uint64_t>(wave, chunks - first);
+        parallelFor(count, threadCount, [&](size_t w) {
+            uint64_t c = first + w;
+            string& out = text[w];
+            out.clear();
+            if (!spec.binary) {
+                out.reserve(generator.chunkRows(c) * 12);
+                char digits[24];
+                generator.generateChunk(c, chunkStart[c], [&](const Passenger& p) {
+                    out.append(digits, formatInt(p.arrivalTime, digits));
+                    out += ',';
+                    out += p.routeType;
+                    out += ',';
+                    out.append(digits, formatInt(p.boardingTime, digits));
+                    if (p.priority) out += ",1";
+                    out += '\n';
+                });
+                return;
+            }
+            routeColumn[w].clear();
+            boardingColumn[w].clear();
+            long long previous = c == 0 ? 0 : generator.arrivalTime(chunkStart[c]);
+            generator.generateChunk(c, chunkStart[c], [&](const Passenger& p) {
+                routeColumn[w] += p.routeType;
+                appendLittleEndian(boardingColumn[w], p.boardingTime, boardingWidth);
+                appendArrivalDelta(out, p.arrivalTime - previous);
+                previous = p.arrivalTime;
+            });
+        });
+
+        for (size_t w = 0; w < count; w++) {
+            uint64_t rowOffset = (first + w) * GENERATOR_CHUNK_ROWS;
+            if (spec.binary) {
+                file.seekp(routeOffset + rowOffset);
+                file.write(routeColumn[w].data(), routeColumn[w].size());
+                file.seekp(boardingOffset + rowOffset * boardingWidth);
+                file.write(boardingColumn[w].data(), boardingColumn[w].size());
+                file.seekp(arrivalOffset + arrivalBytes);
+                arrivalBytes += text[w].size();
+                bytesWritten += routeColumn[w].size() + boardingColumn[w].size();
+            }
+            file.write(text[w].data(), text[w].size());
+            bytesWritten += text[w].size();
+        }
+        if (!file) throw runtime_error("Failed while writing output file. " + filename);
+    }
+
+    if (spec.binary) {
+        string header = binaryTraceHeader(boardingWidth, spec.rows, arrivalBytes);
+        file.seekp(0);
+        file.write(header.data(), header.size());
+        bytesWritten += header.size();
+    }
+    file.close();
+    if (!file) throw runtime_error("Failed while writing output file. " + filename);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cerr << "Generated " << spec.rows << " passengers (" << bytesWritten << " bytes, arrivals up to t="
+         << lastArrival << ") to " << filename << " in " << fixed << setprecision(2) << seconds << " s ("
+         << setprecision(1) << bytesWritten / 1e6 / max(seconds, 1e-9) << " MB/s)" << defaultfloat << endl;
+}
+
+// Benchmark harness. For each trace size it generates a synthetic trace and
+// times the phases of a run on their own, keeping the best of several
+// repeats: loading the CSV (readFileData), the arrival and dispatch loop with
+// no output (runSimulation with a writer that only counts rows, then again
+// under each non-FIFO boarding policy), the boarding
+// rules alone (processTaxiRoute on pre-filled queues) and rendering the table.
+// Results go out as JSON lines, one per phase and size, so two versions can
+// be compared by a script.
+struct BenchmarkResult {
+    string phase;
+    uint64_t passengers = 0;
+    double seconds = 0.0;
+    long long events = 0;       // 0 when the phase has no events.
+    long long ticks = 0;        // Event times, or processTaxiRoute calls for the boarding phase.
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;         // Bytes read or rendered.
+};
+
+// Counts time instances; everything else is ignored.
+struct TickCountingWriter : NullWriter {
+    long long ticks = 0;
+    void row(int, const RouteTable&, const RankState&) { ticks++; }
+};
+
+// Counts and discards everything written to it, so rendering is timed
+// without the I/O.
+class DiscardBuffer : public streambuf {
+public:
+    uint64_t bytes = 0;
+
+protected:
+    streamsize xsputn(const char*, streamsize count) override {
+        bytes += count;
+        return count;
+    }
+    int_type overflow(int_type c) override {
+        bytes++;
+        return traits_type::not_eof(c);
+    }
+};
+
+// Runs phase() repeat times and keeps the fastest run.
+template <typename Phase>
+BenchmarkResult bestOf(int repeat, Phase phase) {
+    BenchmarkResult best;
+    for (int i = 0; i < repeat; i++) {
+        uint64_t allocationsBefore = heapAllocations;
+        auto started = chrono::steady_clock::now();
+        BenchmarkResult result = phase();
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        result.allocations = heapAllocations - allocationsBefore;
+        if (i == 0 || result.seconds < best.seconds) best = result;
+    }
+    return best;
+}
+
+// Boarding rules alone: every passenger is queued up front, then each route
+// is processed once per time unit until everyone has boarded.
+BenchmarkResult benchmarkBoarding(const vector<Passenger>& passengerList, const RouteTable& table) {
+    RankState rank(table);
+    for (const Passenger& p : passengerList) {
+        int route = table.routeIndex(p.routeType);
+        if (route < 0) continue;
+        rank.passengerQueues[route].push(p);
+        rank.waitingPassengers++;
+    }
+
+    BenchmarkResult result;
+    result.phase = "boarding";
+    result.passengers = passengerList.size();
+    for (int t = 0; !allProcessingComplete(true, rank); t++) {
+        for (int route = 0; route < table.routeCount(); route++) processTaxiRoute(rank, table, route, t);
+        result.ticks += table.routeCount();
+        while (!rank.eventQueue.empty() && rank.eventQueue.top().time <= t + 1) {
+            rank.eventQueue.pop();
+            result.events++;
+        }
+    }
+    return result;
+}
+
+void printBenchmarkResult(OutputBuffer& out, const BenchmarkResult& r) {
+    char text[512];
+    double seconds = max(r.seconds, 1e-12);
+    // Allocation counts are null unless the allocator was replaced to count them.
+    char allocations[32] = "null";
+    char perPassenger[32] = "null";
+    if (countsAllocations) {
+        snprintf(allocations, sizeof(allocations), "%llu", static_cast<unsigned long long>(r.allocations));
+        snprintf(perPassenger, sizeof(perPassenger), "%.4f",
+                 r.passengers > 0 ? static_cast<double>(r.allocations) / r.passengers : 0.0);
+    }
+    int length = snprintf(text, sizeof(text),
+        "{\"phase\":\"%s\",\"passengers\":%llu,\"seconds\":%.6f,\"passengers_per_sec\":%.0f,"
+        "\"events\":%lld,\"events_per_sec\":%.0f,\"ticks\":%lld,\"ns_per_tick\":%.1f,"
+        "\"allocations\":%s,\"allocations_per_passenger\":%s,\"bytes\":%llu,\"mb_per_sec\":%.1f}\n",
+        r.phase.c_str(), static_cast<unsigned long long>(r.passengers), r.seconds, r.passengers / seconds,
+        r.events, r.events / seconds, r.ticks, r.ticks > 0 ? r.seconds * 1e9 / r.ticks : 0.0,
+        allocations, perPassenger, static_cast<unsigned long long>(r.bytes), r.bytes / seconds / 1e6);
+    out.append(text, length);
+}
+
+void runBenchmark(const vector<uint64_t>& sizes, int repeat, const RouteTable& table, uint64_t seed,
+                  int threadCount, OutputBuffer& out) {
+    // A load the default rank can keep up with, so queues stay realistic.
+    WorkloadSpec workload;
+    workload.rate = 1.0;
+    workload.boarding = BoardingDistribution::Uniform;
+    workload.boardingFirst = 1.0;
+    workload.boardingLast = 3.0;
+
+    for (uint64_t size : sizes) {
+        string traceName = "taxi_benchmark_" + to_string(size) + ".tmp";
+        workload.rows = size;
+        generateWorkload(workload, table, seed, threadCount, traceName);
+
+        try {
+            vector<Passenger> passengerList;
+            BenchmarkResult ingest = bestOf(repeat, [&]() {
+                BenchmarkResult r;
+                TraceLoadStats stats;
+                passengerList = readFileData(traceName, stats);
+                r.phase = "ingest";
+                r.passengers = stats.rowsAccepted;
+                r.bytes = stats.bytesRead;
+                return r;
+            });
+
+            BenchmarkResult dispatch = bestOf(repeat, [&]() {
+                BenchmarkResult r;
+                VectorArrivalSource arrivals(passengerList);
+                TickCountingWriter writer;
+                SimulationSummary summary = runSimulation(arrivals, table, writer);
+                r.phase = "dispatch";
+                r.passengers = summary.passengersArrived;
+                r.events = summary.eventsProcessed;
+                r.ticks = writer.ticks;
+                return r;
+            });
+
+            // The same loop under each of the other boarding policies, to show what
+            // a policy costs relative to plain FIFO.
+            vector<BenchmarkResult> policyDispatch;
+            const pair<const char*, PolicyChoice> policies[] = {
+                {"dispatch-timeout", {PolicyKind::Timeout, 10}},
+                {"dispatch-batch", {PolicyKind::Batch, 4}},
+                {"dispatch-priority", {PolicyKind::Priority, 0}},
+            };
+            for (const auto& entry : policies) {
+                policyDispatch.push_back(bestOf(repeat, [&]() {
+                    BenchmarkResult r;
+                    VectorArrivalSource arrivals(passengerList);
+                    TickCountingWriter writer;
+                    SimulationState state(table);
+                    SimulationSummary summary = withPolicy(entry.second, table, [&](auto& policy) {
+                        return continueSimulation(arrivals, table, writer, state, CheckpointSchedule(), policy);
+                    });
+                    r.phase = entry.first;
+                    r.passengers = summary.passengersArrived;
+                    r.events = summary.eventsProcessed;
+                    r.ticks = writer.ticks;
+                    return r;
+                }));
+            }
+
+            BenchmarkResult boarding = bestOf(repeat, [&]() { return benchmarkBoarding(passengerList, table); });
+
+            BenchmarkResult render = bestOf(repeat, [&]() {
+                BenchmarkResult r;
+                DiscardBuffer discard;
+                ostream sink(&discard);
+                SimulationSummary summary;
+                {
+                    OutputBuffer buffer(sink);
+                    TableWriter writer(buffer);
+                    VectorArrivalSource arrivals(passengerList);
+                    summary = runSimulation(arrivals, table, writer);
+                }
+                r.phase = "render";
+                r.bytes = discard.bytes;
+                r.passengers = summary.passengersArrived;
+                r.events = summary.eventsProcessed;
+                r.ticks = dispatch.ticks;
+                return r;
+            });
+            // Rendering on its own is the table run minus the dispatch work under it.
+            render.seconds = max(0.0, render.seconds - dispatch.seconds);
+            render.allocations -= min(render.allocations, dispatch.allocations);
+
+            for (const BenchmarkResult& r : {ingest, dispatch}) printBenchmarkResult(out, r);
+            for (const BenchmarkResult& r : policyDispatch) printBenchmarkResult(out, r);
+            for (const BenchmarkResult& r : {boarding, render}) printBenchmarkResult(out, r);
+            out.flush();
+            cerr << size << " passengers: ingest " << fixed << setprecision(2) << ingest.seconds * 1e3
+                 << " ms, dispatch " << dispatch.seconds * 1e3 << " ms, boarding " << boarding.seconds * 1e3
+                 << " ms, render " << render.seconds * 1e3 << " ms" << defaultfloat << endl;
+        } catch (...) {
+            remove(traceName.c_str());
+            throw;
+        }
+        remove(traceName.c_str());
+    }
+}
+
+bool parseSizeList(const string& text, vector<uint64_t>& sizes) {
+    sizes.clear();
+    stringstream parts(text);
+    string part;
+    while (getline(parts, part, ',')) {
+        char* end = nullptr;
+        double value = strtod(part.c_str(), &end); // Accepts 1e6 as well as 1000000.
+        if (end == part.c_str() || *end != '\0' || !(value >= 1.0)) return false;
+        sizes.push_back(static_cast<uint64_t>(value));
+    }
+    return !sizes.empty();
+}
+
+const string DEFAULT_TRACE_FILE = "taxiData.txt";
+
+// Settings taken from the command line.
+struct ProgramOptions {
+    string traceFile = DEFAULT_TRACE_FILE;
+    vector<string> moreTraceFiles;     // Further traces to merge with traceFile.
+    MergeOptions merge;
+    string routeFile;          // Empty means the built-in S, L and C routes.
+    bool convertMode = false;
+    string convertInput;
+    string convertOutput;
+    int replications = 0;      // Monte Carlo replications; 0 runs the trace once.
+    bool sweepMode = false;    // Set by any of the --sweep-* options.
+    SweepRange sweepCapacity = {TAXI_CAPACITY, TAXI_CAPACITY, 1.0};
+    SweepRange sweepTaxis = {1, 1, 1.0};
+    SweepRange sweepBoarding = {1.0, 1.0, 1.0};
+    uint64_t seed = 1;
+    int threads = defaultThreadCount();
+    size_t queuePreview = DEFAULT_QUEUE_PREVIEW;
+    OutputMode outputMode = OutputMode::Table;
+    string outputFile;         // Empty means standard output.
+    bool generateMode = false;
+    string generateOutput;
+    WorkloadSpec workload;
+    vector<uint64_t> benchmarkSizes;   // Non-empty runs the benchmark.
+    int benchmarkRepeat = 3;
+    string restoreFile;                // Checkpoint to resume from; empty starts at the first arrival.
+    bool streamMode = false;           // Read the CSV trace on a separate thread while simulating.
+    bool partitionRoutes = false;      // Simulate shards of routes on separate threads.
+    PolicyChoice policy;
+    bool estimateMode = false;         // Analytic queueing estimate instead of a simulation.
+    bool estimateCheck = false;        // Also simulate and report the estimate's error.
+    vector<pair<char, double>> estimateRates;  // What-if arrival rates per route label.
+    string liveMetrics;                // Shared-memory segment to publish progress to.
+    vector<uint64_t> dispatchWorkers;  // Non-empty runs the real-time dispatcher load test.
+    int dispatchProducers = 1;
+    double replayRate = 0.0;           // Trace time units per second; 0 is as fast as possible.
+    string watchSegment;               // Segment to read instead of simulating.
+    int watchInterval = 500;           // Milliseconds between reads.
+    bool watchJson = false;
+    size_t streamWindow = DEFAULT_STREAM_WINDOW;
+    CheckpointSchedule checkpoints;
+};
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " [--routes <route-table>] [--output table|csv|binary|summary]\n"
+         << "           [--policy fifo|timeout:<units>|batch:<size>|priority]\n"
+         << "           [--output-file <file>] [--queue-preview <k>] [--checkpoint-every <units>]\n"
+         << "           [--checkpoint-prefix <prefix>] [--restore <checkpoint>]\n"
+         << "           [--stream [--stream-window <passengers>]] [--parallel-routes [--threads <t>]]\n"
+         << "           [--sort [--sort-memory <MB>] [--sort-prefix <prefix>]] [--live-metrics <segment>]\n"
+         << "           [trace-file... | -]\n"
+         << "       " << program << " --watch <segment> [--watch-interval <ms>] [--watch-format text|json]\n"
+         << "       " << program << " --replications <n> [--seed <s>] [--threads <t>] [--routes <route-table>] [trace-file]\n"
+         << "       " << program << " [--sweep-capacity <a:b[:step]>] [--sweep-taxis <a:b[:step]>]\n"
+         << "           [--sweep-boarding <a:b[:step]>] [--threads <t>] [--routes <route-table>] [trace-file]\n"
+         << "       " << program << " --estimate [--estimate-check] [--estimate-rate L=0.011,...] [--routes <route-table>]\n"
+         << "           [trace-file]\n"
+         << "       " << program << " --dispatch <workers,workers,...> [--producers <p>] [--replay-rate <units-per-sec>]\n"
+         << "           [--routes <route-table>] [trace-file]\n"
+         << "       " << program << " --convert <csv-file> <binary-file>\n"
+         << "       " << program << " --generate <rows> <file> [--format csv|binary] [--rate <passengers-per-unit>]\n"
+         << "           [--arrivals poisson|diurnal] [--day-length <units>] [--route-mix S=0.5,L=0.2,C=0.3]\n"
+         << "           [--burst-prob <p> --burst-size <k>] [--boarding fixed:v|uniform:a:b|exponential:mean]\n"
+         << "           [--priority-share <p>]\n"
+         << "           [--seed <s>] [--threads <t>] [--routes <route-table>]\n"
+         << "       " << program << " --benchmark <size,size,...> [--bench-repeat <r>] [--output-file <file>]\n"
+         << "The trace file may be CSV or binary; the format is detected from its header.\n"
+         << "Several trace files, each in arrival order, are merged into one stream; --sort\n"
+         << "accepts files in any order and sorts them on disk in bounded memory.\n"
+         << "A route table lists one \"routeType,taxis[,capacity]\" line per route." << endl;
+}
+
+bool parseArguments(int argc, char* argv[], ProgramOptions& options) {
+    bool traceGiven = false;
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "--convert" && i + 2 < argc) {
+            options.convertMode = true;
+            options.convertInput = argv[++i];
+            options.convertOutput = argv[++i];
+        } else if (argument == "--generate" && i + 2 < argc) {
+            options.generateMode = true;
+            options.workload.rows = strtoull(argv[++i], nullptr, 10);
+            options.generateOutput = argv[++i];
+            if (options.workload.rows == 0) return false;
+        } else if (argument == "--format" && i + 1 < argc) {
+            string format = argv[++i];
+            if (format != "csv" && format != "binary") return false;
+            options.workload.binary = format == "binary";
+        } else if (argument == "--rate" && i + 1 < argc) {
+            options.workload.rate = strtod(argv[++i], nullptr);
+            if (!(options.workload.rate > 0.0)) return false;
+        } else if (argument == "--arrivals" && i + 1 < argc) {
+            string pattern = argv[++i];
+            if (pattern != "poisson" && pattern != "diurnal") return false;
+            options.workload.pattern = pattern == "poisson" ? ArrivalPattern::Poisson : ArrivalPattern::Diurnal;
+        } else if (argument == "--day-length" && i + 1 < argc) {
+            options.workload.dayLength = strtod(argv[++i], nullptr);
+            if (!(options.workload.dayLength > 0.0)) return false;
+        } else if (argument == "--route-mix" && i + 1 < argc) {
+            if (!parseRouteMix(argv[++i], options.workload)) return false;
+        } else if (argument == "--burst-prob" && i + 1 < argc) {
+            options.workload.burstProbability = strtod(argv[++i], nullptr);
+            if (!(options.workload.burstProbability >= 0.0 && options.workload.burstProbability <= 1.0)) return false;
+        } else if (argument == "--priority-share" && i + 1 < argc) {
+            options.workload.priorityShare = strtod(argv[++i], nullptr);
+            if (!(options.workload.priorityShare >= 0.0 && options.workload.priorityShare <= 1.0)) return false;
+        } else if (argument == "--policy" && i + 1 < argc) {
+            if (!parsePolicy(argv[++i], options.policy)) return false;
+        } else if (argument == "--burst-size" && i + 1 < argc) {
+            options.workload.burstSize = atoi(argv[++i]);
+            if (options.workload.burstSize < 1) return false;
+        } else if (argument == "--boarding" && i + 1 < argc) {
+            if (!parseBoardingDistribution(argv[++i], options.workload)) return false;
+        } else if (argument == "--benchmark" && i + 1 < argc) {
+            if (!parseSizeList(argv[++i], options.benchmarkSizes)) return false;
+        } else if (argument == "--bench-repeat" && i + 1 < argc) {
+            options.benchmarkRepeat = atoi(argv[++i]);
+            if (options.benchmarkRepeat < 1) return false;
+        } else if (argument == "--checkpoint-every" && i + 1 < argc) {
+            options.checkpoints.interval = atoi(argv[++i]);
+            if (options.checkpoints.interval < 1) return false;
+        } else if (argument == "--checkpoint-prefix" && i + 1 < argc) {
+            options.checkpoints.prefix = argv[++i];
+        } else if (argument == "--restore" && i + 1 < argc) {
+            options.restoreFile = argv[++i];
+        } else if (argument == "--parallel-routes") {
+            options.partitionRoutes = true;
+        } else if (argument == "--stream") {
+            options.streamMode = true;
+        } else if (argument == "--stream-window" && i + 1 < argc) {
+            options.streamWindow = strtoul(argv[++i], nullptr, 10);
+            if (options.streamWindow == 0) return false;
+        } else if (argument == "--routes" && i + 1 < argc) {
+            options.routeFile = argv[++i];
+        } else if (argument == "--replications" && i + 1 < argc) {
+            options.replications = atoi(argv[++i]);
+            if (options.replications < 1) return false;
+        } else if (argument == "--sweep-capacity" && i + 1 < argc) {
+            if (!parseSweepRange(argv[++i], options.sweepCapacity)) return false;
+            options.sweepMode = true;
+        } else if (argument == "--sweep-taxis" && i + 1 < argc) {
+            if (!parseSweepRange(argv[++i], options.sweepTaxis)) return false;
+            options.sweepMode = true;
+        } else if (argument == "--sweep-boarding" && i + 1 < argc) {
+            if (!parseSweepRange(argv[++i], options.sweepBoarding)) return false;
+            options.sweepMode = true;
+        } else if (argument == "--output" && i + 1 < argc) {
+            if (!parseOutputMode(argv[++i], options.outputMode)) return false;
+        } else if (argument == "--output-file" && i + 1 < argc) {
+            options.outputFile = argv[++i];
+        } else if (argument == "--queue-preview" && i + 1 < argc) {
+            options.queuePreview = strtoul(argv[++i], nullptr, 10);
+        } else if (argument == "--seed" && i + 1 < argc) {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (argument == "--threads" && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+            if (options.threads < 1) return false;
+        } else if (argument == "--estimate") {
+            options.estimateMode = true;
+        } else if (argument == "--estimate-check") {
+            options.estimateMode = true;
+            options.estimateCheck = true;
+        } else if (argument == "--estimate-rate" && i + 1 < argc) {
+            WorkloadSpec rates;   // Same "S=0.5,L=0.2" syntax as --route-mix.
+            if (!parseRouteMix(argv[++i], rates)) return false;
+            for (size_t r = 0; r < rates.routes.size(); r++) {
+                options.estimateRates.push_back({rates.routes[r], rates.routeWeights[r]});
+            }
+            options.estimateMode = true;
+        } else if (argument == "--dispatch" && i + 1 < argc) {
+            if (!parseSizeList(argv[++i], options.dispatchWorkers)) return false;
+        } else if (argument == "--producers" && i + 1 < argc) {
+            options.dispatchProducers = atoi(argv[++i]);
+            if (options.dispatchProducers < 1) return false;
+        } else if (argument == "--replay-rate" && i + 1 < argc) {
+            options.replayRate = strtod(argv[++i], nullptr);
+            if (!(options.replayRate >= 0.0)) return false;
+        } else if (argument == "--live-metrics" && i + 1 < argc) {
+            options.liveMetrics = argv[++i];
+        } else if (argument == "--watch" && i + 1 < argc) {
+            options.watchSegment = argv[++i];
+        } else if (argument == "--watch-interval" && i + 1 < argc) {
+            options.watchInterval = atoi(argv[++i]);
+            if (options.watchInterval < 1) return false;
+        } else if (argument == "--watch-format" && i + 1 < argc) {
+            string format = argv[++i];
+            if (format != "text" && format != "json") return false;
+            options.watchJson = format == "json";
+        } else if (argument == "--sort") {
+            options.merge.sort = true;
+        } else if (argument == "--sort-memory" && i + 1 < argc) {
+            double megabytes = strtod(argv[++i], nullptr);
+            if (!(megabytes >= 1.0)) return false;
+            options.merge.memoryBytes = static_cast<size_t>(megabytes * 1024 * 1024);
+        } else if (argument == "--sort-prefix" && i + 1 < argc) {
+            options.merge.runPrefix = argv[++i];
+        } else if (!argument.empty() && (argument[0] != '-' || argument == "-") && !traceGiven) {
+            options.traceFile = argument;
+            traceGiven = true;
+        } else if (!argument.empty() && argument[0] != '-') {
+            options.moreTraceFiles.push_back(argument);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    ProgramOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try {
+        if (options.convertMode) {
+            convertTrace(options.convertInput, options.convertOutput);
+            return 0;
+        }
+        if (!options.watchSegment.empty()) {
+            watchLiveMetrics(options.watchSegment, options.watchInterval, options.watchJson, cout);
+            return 0;
+        }
+
+        RouteTable table = options.routeFile.empty() ? defaultRouteTable() : loadRouteTable(options.routeFile);
+        if (options.generateMode) {
+            generateWorkload(options.workload, table, options.seed, options.threads, options.generateOutput);
+            return 0;
+        }
+
+        ofstream outputFile;
+        if (!options.outputFile.empty()) {
+            outputFile.open(options.outputFile, ios::binary | ios::trunc);
+            if (!outputFile.is_open()) throw runtime_error("Unable to open output file. " + options.outputFile);
+        }
+        ostream& results = options.outputFile.empty() ? cout : outputFile;
+        OutputBuffer output(results);
+
+        if (!options.benchmarkSizes.empty()) {
+            runBenchmark(options.benchmarkSizes, options.benchmarkRepeat, table, options.seed, options.threads, output);
+            return 0;
+        }
+
+        if (options.policy.kind != PolicyKind::Fifo
+            && (options.replications > 0 || options.sweepMode || options.partitionRoutes)) {
+            throw runtime_error("Replications, sweeps and route shards use FIFO boarding only.");
+        }
+        if (options.estimateCheck && !options.estimateRates.empty()) {
+            throw runtime_error("What-if rates cannot be checked against a simulation of the trace.");
+        }
+        // The priority policy keeps its own view of each queue, which checkpoints do not record.
+        if (options.policy.kind == PolicyKind::Priority
+            && (options.checkpoints.interval > 0 || !options.restoreFile.empty())) {
+            throw runtime_error("Priority boarding cannot be checkpointed or restored.");
+        }
+        // Modes that take the whole trace run their own simulations (or none) from time 0.
+        bool needsWholeTrace = options.replications > 0 || options.sweepMode || options.partitionRoutes ||
+                               options.estimateMode || !options.dispatchWorkers.empty();
+        if (needsWholeTrace && (options.checkpoints.interval > 0 || !options.restoreFile.empty())) {
+            throw runtime_error("Replications, sweeps, estimates, dispatch load tests and route shards cannot be "
+                                "checkpointed or restored.");
+        }
+
+        unique_ptr<LiveMetricsPublisher> live;
+        if (!options.liveMetrics.empty()) {
+            if (options.replications > 0 || options.sweepMode || options.partitionRoutes || options.estimateMode ||
+                !options.dispatchWorkers.empty()) {
+                throw runtime_error("Live metrics are published by single simulation runs only.");
+            }
+            live.reset(new LiveMetricsPublisher(options.liveMetrics, table));
+        }
+
+        SimulationState state = options.restoreFile.empty() ? SimulationState(table)
+                                                            : readCheckpoint(options.restoreFile, table);
+        if (!options.restoreFile.empty()) {
+            cerr << "Resuming after time " << state.previousTime << " from checkpoint " << options.restoreFile << endl;
+        }
+
+        const string& filename = options.traceFile;
+        bool ordering = options.merge.sort || !options.moreTraceFiles.empty();
+        if (options.streamMode || filename == "-") {
+            if (needsWholeTrace) {
+                throw runtime_error("Replications, sweeps, estimates and route shards need the whole trace; they cannot stream it.");
+            }
+            if (ordering) throw runtime_error("Merged or sorted traces are read from files; they cannot stream.");
+            StreamArrivalSource arrivals(filename, options.streamWindow);
+            runWithOutput(arrivals, table, options.outputMode, options.queuePreview, output, state, options.checkpoints,
+                          options.policy, live.get());
+            printLoadSummary(filename == "-" ? "standard input" : filename, arrivals.stats());
+            return 0;
+        }
+
+        vector<Passenger> allPassengers;
+        if (ordering) {
+            vector<string> traceFiles = {filename};
+            traceFiles.insert(traceFiles.end(), options.moreTraceFiles.begin(), options.moreTraceFiles.end());
+            MergeOptions merge = options.merge;
+            if (merge.runPrefix.empty()) merge.runPrefix = filename + ".sort";
+
+            if (!needsWholeTrace) {
+                withOrderedTraces(traceFiles, merge, [&](auto& arrivals) {
+                    return runWithOutput(arrivals, table, options.outputMode, options.queuePreview, output, state,
+                                         options.checkpoints, options.policy, live.get());
+                });
+                return 0;
+            }
+            withOrderedTraces(traceFiles, merge, [&](auto& arrivals) {
+                for (; !arrivals.done(); arrivals.advance()) allPassengers.push_back(arrivals.peek());
+                return SimulationSummary();
+            });
+        } else {
+            MappedFile traceFile(filename);
+
+            if (isBinaryTrace(traceFile) && !needsWholeTrace) {
+                BinaryArrivalSource arrivals(traceFile);
+                cerr << "Replaying " << arrivals.size() << " passengers from binary trace " << filename << endl;
+                runWithOutput(arrivals, table, options.outputMode, options.queuePreview, output, state,
+                              options.checkpoints, options.policy, live.get());
+                return 0;
+            }
+
+            if (isBinaryTrace(traceFile)) {
+                for (BinaryArrivalSource source(traceFile); !source.done(); source.advance()) {
+                    allPassengers.push_back(source.peek());
+                }
+            } else {
+                TraceLoadStats loadStats;
+                allPassengers = parseTrace(traceFile, loadStats);
+                printLoadSummary(filename, loadStats);
+            }
+        }
+
+        if (!options.dispatchWorkers.empty()) {
+            runDispatchLoadTest(allPassengers, table, options.dispatchWorkers, options.dispatchProducers,
+                                options.replayRate, results);
+        } else if (options.estimateMode) {
+            vector<double> rateOverride(table.routeCount(), -1.0);
+            for (const auto& rate : options.estimateRates) {
+                int route = table.routeIndex(rate.first);
+                if (route < 0) throw runtime_error(string("Route ") + rate.first + " is not in the route table.");
+                rateOverride[route] = rate.second;
+            }
+            runEstimate(allPassengers, table, rateOverride, options.estimateCheck, results);
+        } else if (options.sweepMode) {
+            runSweep(allPassengers, table, options.sweepCapacity, options.sweepTaxis, options.sweepBoarding,
+                     options.threads, results);
+        } else if (options.replications > 0) {
+            runReplications(allPassengers, table, options.replications, options.seed, options.threads, results);
+        } else if (options.partitionRoutes) {
+            withOutputWriter(options.outputMode, options.queuePreview, output, [&](auto& writer) {
+                return runPartitioned(allPassengers, table, writer, options.threads);
+            });
+        } else {
+            VectorArrivalSource arrivals(allPassengers);
+            runWithOutput(arrivals, table, options.outputMode, options.queuePreview, output, state, options.checkpoints,
+                          options.policy, live.get());
+        }
+    } catch (const exception& e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}